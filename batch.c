@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BATCH_DEFAULT_READERS 4
+
+// Reader threads claim files by index and push their contents into a
+// bounded queue drained by the parse workers, so reading the next files
+// overlaps with parsing the previous ones. Every file has a slot allocated
+// up front, so even a file that couldn't be read reaches a worker.
+
+typedef struct Json_batch_file {
+  const char *path;
+  char *content;
+  size_t length;
+} Json_batch_file;
+
+typedef struct Json_batch {
+  const char **paths;
+  Json_batch_file *slots; // One per path
+  size_t count;
+  size_t next;
+  pthread_mutex_t lock;
+  Queue files;
+  unsigned int flags;
+  Json_batch_callback callback;
+  void *user_data;
+} Json_batch;
+
+int batch_read_file(const char *path, char **content, size_t *length)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR! can't open file %s\n", path);
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return 0;
+  }
+
+  size_t capacity = st.st_size > 0 ? (size_t)st.st_size : 4096;
+  size_t size = 0;
+  char *data = (char *)malloc(capacity + 1);
+  if (!data) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for file %s\n", path);
+    close(fd);
+    return 0;
+  }
+
+  for (;;) {
+    if (size == capacity) {
+      char *grown = (char *)realloc(data, capacity * 2 + 1);
+      if (!grown) {
+        fprintf(stderr, "ERROR! Couldn't allocate memory for file %s\n", path);
+        free(data);
+        close(fd);
+        return 0;
+      }
+      data = grown;
+      capacity *= 2;
+    }
+    ssize_t n = read(fd, data + size, capacity - size);
+    if (n < 0) {
+      fprintf(stderr, "ERROR! Couldn't read file %s\n", path);
+      free(data);
+      close(fd);
+      return 0;
+    }
+    if (n == 0) {
+      break;
+    }
+    size += (size_t)n;
+  }
+  close(fd);
+
+  data[size] = '\0';
+  *content = data;
+  *length = size;
+  return 1;
+}
+
+void *batch_reader(void *arg)
+{
+  Json_batch *batch = (Json_batch *)arg;
+
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    size_t index = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (index >= batch->count) {
+      break;
+    }
+
+    Json_batch_file *file = &batch->slots[index];
+    file->path = batch->paths[index];
+    if (!batch_read_file(file->path, &file->content, &file->length)) {
+      file->content = NULL;
+    }
+    if (!queue_push(&batch->files, file)) {
+      free(file->content);
+      file->content = NULL;
+    }
+  }
+  return NULL;
+}
+
+void *batch_worker(void *arg)
+{
+  Json_batch *batch = (Json_batch *)arg;
+  json_parser parser = {0};
+  parser.flags = batch->flags;
+  void *item;
+
+  while (queue_pop(&batch->files, &item)) {
+    Json_batch_file *file = (Json_batch_file *)item;
+    Json_object object = {0};
+    int ok = file->content && json_parse_buffer(&parser, file->content, file->length, &object);
+
+    batch->callback(file->path, &object, ok, batch->user_data);
+    json_unload(&object);
+    free(file->content);
+    file->content = NULL;
+  }
+  return NULL;
+}
+
+int json_parse_files(const char **paths, size_t count, const Json_batch_options *options,
+                     Json_batch_callback callback, void *user_data)
+{
+  Json_batch_options defaults = {0};
+  if (options) {
+    defaults = *options;
+  }
+  if (defaults.workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    defaults.workers = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (defaults.readers == 0) {
+    defaults.readers = BATCH_DEFAULT_READERS;
+  }
+  if (defaults.queue_size == 0) {
+    defaults.queue_size = defaults.workers * 2;
+  }
+
+  Json_batch batch = {
+    .paths = paths,
+    .count = count,
+    .next = 0,
+    .flags = defaults.flags,
+    .callback = callback,
+    .user_data = user_data
+  };
+  if (!queue_new(&batch.files, defaults.queue_size)) {
+    return 0;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+
+  batch.slots = (Json_batch_file *)calloc(count > 0 ? count : 1, sizeof(Json_batch_file));
+  pthread_t *threads = (pthread_t *)malloc((defaults.readers + defaults.workers) * sizeof(pthread_t));
+  if (!batch.slots || !threads) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for batch threads\n");
+    free(batch.slots);
+    free(threads);
+    queue_deallocate(&batch.files);
+    pthread_mutex_destroy(&batch.lock);
+    return 0;
+  }
+
+  size_t readers = 0;
+  size_t workers = 0;
+  for (size_t i = 0; i < defaults.readers; i++) {
+    if (pthread_create(&threads[readers], NULL, batch_reader, &batch) == 0) {
+      readers++;
+    }
+  }
+  for (size_t i = 0; i < defaults.workers; i++) {
+    if (pthread_create(&threads[readers + workers], NULL, batch_worker, &batch) == 0) {
+      workers++;
+    }
+  }
+
+  int ok = readers > 0 && workers > 0;
+  if (!ok) {
+    fprintf(stderr, "ERROR! Couldn't start batch threads\n");
+    pthread_mutex_lock(&batch.lock);
+    batch.next = count; // Stop the readers that did start
+    pthread_mutex_unlock(&batch.lock);
+    queue_close(&batch.files);
+  }
+
+  for (size_t i = 0; i < readers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  queue_close(&batch.files);
+  for (size_t i = 0; i < workers; i++) {
+    pthread_join(threads[readers + i], NULL);
+  }
+
+  // Files left behind when no worker could start
+  void *item;
+  while (queue_pop(&batch.files, &item)) {
+    free(((Json_batch_file *)item)->content);
+  }
+
+  free(batch.slots);
+  free(threads);
+  queue_deallocate(&batch.files);
+  pthread_mutex_destroy(&batch.lock);
+  return ok;
+}
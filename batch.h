@@ -0,0 +1,21 @@
+#ifndef __BATCH__
+#define __BATCH__
+
+#include "json.h"
+
+// Called from the parse workers, possibly concurrently. The document is
+// unloaded once the callback returns; ok is 0 when the file couldn't be read
+// or parsed.
+typedef void (*Json_batch_callback)(const char *path, Json_object *obj, int ok, void *user_data);
+
+typedef struct Json_batch_options {
+  size_t readers;     // I/O threads, 0 for the default
+  size_t workers;     // Parse threads, 0 for one per CPU
+  size_t queue_size;  // Files read but not parsed yet, 0 for the default
+  unsigned int flags; // json_parser flags
+} Json_batch_options;
+
+int json_parse_files(const char **paths, size_t count, const Json_batch_options *options,
+                     Json_batch_callback callback, void *user_data);
+
+#endif // __BATCH__
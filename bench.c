@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+
+#include "json.h"
+
+// Compares the generic void* Vector/HashMap against the macro-generated
+// Json_node_vector/Json_node_map used by the parser.
+
+#define BENCH_ELEMENTS 1000
+#define BENCH_ROUNDS 2000
+#define BENCH_KEYS 500
+
+double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void report(const char *name, double generic, double typed)
+{
+  printf("%-24s generic %8.2f ms   typed %8.2f ms   speedup %.2fx\n",
+         name, generic * 1e3, typed * 1e3, generic / typed);
+}
+
+// Each variant runs in its own loop so one doesn't inherit the other's
+// allocator state
+void bench_vector(void)
+{
+  Json_node node = {.type = JSON_NODE_NUMBER};
+  double sum = 0;
+  double generic_push = 0, typed_push = 0, generic_get = 0, typed_get = 0;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    Vector generic;
+    double start = now();
+    vector_new(&generic, sizeof(Json_node), 1);
+    for (size_t i = 0; i < BENCH_ELEMENTS; i++) {
+      node.number_value = (double)i;
+      vector_push_back(&generic, &node);
+    }
+    generic_push += now() - start;
+
+    start = now();
+    for (size_t i = 0; i < generic.size; i++) {
+      sum += ((Json_node *)vector_get_ref_at(&generic, i))->number_value;
+    }
+    generic_get += now() - start;
+    vector_deallocate(&generic);
+  }
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    Json_node_vector typed;
+    double start = now();
+    Json_node_vector_new(&typed, 1);
+    for (size_t i = 0; i < BENCH_ELEMENTS; i++) {
+      node.number_value = (double)i;
+      Json_node_vector_push_back(&typed, &node);
+    }
+    typed_push += now() - start;
+
+    start = now();
+    for (size_t i = 0; i < typed.size; i++) {
+      sum += Json_node_vector_get_ref_at(&typed, i)->number_value;
+    }
+    typed_get += now() - start;
+    Json_node_vector_deallocate(&typed);
+  }
+
+  report("vector push_back", generic_push, typed_push);
+  report("vector get_ref_at", generic_get, typed_get);
+  if (sum < 0) {
+    printf("%f\n", sum);
+  }
+}
+
+void bench_hashmap(void)
+{
+  static char keys[BENCH_KEYS][16];
+  double sum = 0;
+  double generic_insert = 0, typed_insert = 0, generic_search = 0, typed_search = 0;
+
+  for (size_t i = 0; i < BENCH_KEYS; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "key%zu", i);
+  }
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    HashMap generic;
+    Json_node_map typed;
+
+    double start = now();
+    hashmap_new(&generic, compare_strings, hash_string);
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+      Json_node *value = (Json_node *)malloc(sizeof(Json_node));
+      value->type = JSON_NODE_NUMBER;
+      value->number_value = (double)i;
+      hashmap_insert(&generic, keys[i], value);
+    }
+    generic_insert += now() - start;
+
+    start = now();
+    Json_node_map_new(&typed);
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+      int created;
+      Json_node *value = Json_node_map_emplace(&typed, keys[i], &created);
+      value->type = JSON_NODE_NUMBER;
+      value->number_value = (double)i;
+    }
+    typed_insert += now() - start;
+
+    start = now();
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+      sum += ((Json_node *)hashmap_search(&generic, keys[i]))->number_value;
+    }
+    generic_search += now() - start;
+
+    start = now();
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+      sum += Json_node_map_search(&typed, keys[i])->number_value;
+    }
+    typed_search += now() - start;
+
+    for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+      for (HashMapEntry *entry = generic.buckets[i]; entry; entry = entry->next) {
+        free(entry->value);
+      }
+    }
+    hashmap_deallocate(&generic);
+    Json_node_map_deallocate(&typed);
+  }
+
+  report("hashmap insert", generic_insert, typed_insert);
+  report("hashmap search", generic_search, typed_search);
+  if (sum < 0) {
+    printf("%f\n", sum);
+  }
+}
+
+int main()
+{
+  bench_vector();
+  bench_hashmap();
+  return 0;
+}
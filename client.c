@@ -0,0 +1,170 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "client.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef enum {
+  CLIENT_FOUND,
+  CLIENT_MISSING,
+  CLIENT_ERROR
+} CLIENT_STATUS;
+
+int json_client_connect(Json_client *client, const char *socket_path)
+{
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+  client->fd = -1;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "ERROR! Socket path %s is too long\n", socket_path);
+    return 0;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  if (!vector_new(&client->input, 1, 4096)) {
+    return 0;
+  }
+  client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (client->fd < 0 || connect(client->fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    fprintf(stderr, "ERROR! Couldn't connect to %s: %s\n", socket_path, strerror(errno));
+    json_client_close(client);
+    return 0;
+  }
+  return 1;
+}
+
+int client_send(int fd, const char *data, size_t length)
+{
+  while (length > 0) {
+    ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      perror("send");
+      return 0;
+    }
+    data += n;
+    length -= (size_t)n;
+  }
+  return 1;
+}
+
+// A request that failed halfway leaves the stream out of step with its
+// responses, so the connection is closed and fd set to -1
+void client_disconnect(Json_client *client)
+{
+  if (client->fd >= 0) {
+    close(client->fd);
+  }
+  client->fd = -1;
+}
+
+// Sends one request and waits for its response line. On CLIENT_FOUND the
+// value's JSON text is appended to out.
+CLIENT_STATUS client_request(Json_client *client, const char *verb, const char *document, const char *argument,
+                             Vector *out)
+{
+  if (strpbrk(document, "\t\n") || strpbrk(argument, "\t\n")) {
+    fprintf(stderr, "ERROR! Requests can't contain tabs or newlines\n");
+    return CLIENT_ERROR;
+  }
+
+  if (client->fd < 0) {
+    fprintf(stderr, "ERROR! The connection to the daemon is closed\n");
+    return CLIENT_ERROR;
+  }
+
+  client->input.size = 0;
+  int ok = vector_append(&client->input, (void *)verb, strlen(verb)) &&
+           vector_append(&client->input, " ", 1) &&
+           vector_append(&client->input, (void *)document, strlen(document)) &&
+           vector_append(&client->input, "\t", 1) &&
+           vector_append(&client->input, (void *)argument, strlen(argument)) &&
+           vector_append(&client->input, "\n", 1);
+  if (!ok) {
+    return CLIENT_ERROR;
+  }
+  if (!client_send(client->fd, client->input.items, client->input.size)) {
+    client_disconnect(client);
+    return CLIENT_ERROR;
+  }
+
+  client->input.size = 0;
+  char *newline = NULL;
+  while (!newline) {
+    if (!vector_reserve(&client->input, client->input.size + 4096)) {
+      client_disconnect(client);
+      return CLIENT_ERROR;
+    }
+    ssize_t n = recv(client->fd, (char *)client->input.items + client->input.size, 4096, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      if (n < 0) {
+        perror("recv");
+      } else {
+        fprintf(stderr, "ERROR! The daemon closed the connection\n");
+      }
+      client_disconnect(client);
+      return CLIENT_ERROR;
+    }
+    newline = memchr((char *)client->input.items + client->input.size, '\n', (size_t)n);
+    client->input.size += (size_t)n;
+  }
+
+  char *line = (char *)client->input.items;
+  size_t length = newline - line;
+  if (length >= 3 && memcmp(line, "OK ", 3) == 0) {
+    return vector_append(out, line + 3, length - 3) ? CLIENT_FOUND : CLIENT_ERROR;
+  }
+  if (length == 7 && memcmp(line, "MISSING", 7) == 0) {
+    return CLIENT_MISSING;
+  }
+  fprintf(stderr, "ERROR! The daemon answered: %.*s\n", (int)length, line);
+  return CLIENT_ERROR;
+}
+
+// Appends the JSON text of the value at path to out. Like json_query, a
+// missing path fails without an error message.
+int json_client_query(Json_client *client, const char *document, const char *path, Vector *out)
+{
+  return client_request(client, "QUERY", document, path, out) == CLIENT_FOUND;
+}
+
+// Looks up a top-level key of a document held by the daemon and parses
+// the value into value, which the caller unloads
+int json_client_search_key(Json_client *client, const char *document, char *key, Json_object *value)
+{
+  if (!document || !key || !*key || !value) {
+    fprintf(stderr, "Error! Some parameter are missing\n");
+    return 0;
+  }
+
+  Vector text;
+  if (!vector_new(&text, 1, 256)) {
+    return 0;
+  }
+  CLIENT_STATUS status = client_request(client, "KEY", document, key, &text);
+  if (status == CLIENT_MISSING) {
+    fprintf(stderr, "ERROR! key \"%s\" doesn't exist\n", key);
+  }
+
+  int ok = 0;
+  if (status == CLIENT_FOUND) {
+    json_parser parser = {0};
+    ok = json_parse_buffer(&parser, text.items, text.size, value);
+  }
+  vector_deallocate(&text);
+  return ok;
+}
+
+void json_client_close(Json_client *client)
+{
+  client_disconnect(client);
+  vector_deallocate(&client->input);
+}
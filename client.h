@@ -0,0 +1,18 @@
+#ifndef __CLIENT__
+#define __CLIENT__
+
+#include "json.h"
+
+// Connection to a json_daemon, see daemon.h for the protocol. Requests are
+// answered in order, one at a time per client.
+typedef struct Json_client {
+  int fd;       // -1 once the connection is lost, requests then fail at once
+  Vector input; // char, bytes received after the last response
+} Json_client;
+
+int json_client_connect(Json_client *client, const char *socket_path);
+int json_client_query(Json_client *client, const char *document, const char *path, Vector *out);
+int json_client_search_key(Json_client *client, const char *document, char *key, Json_object *value);
+void json_client_close(Json_client *client);
+
+#endif // __CLIENT__
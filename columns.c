@@ -0,0 +1,614 @@
+#include "columns.h"
+#include "validate.h"
+
+#include <errno.h>
+
+// Records are scanned straight from the text into per-column buffers, no
+// Json_node is built. With several threads the array is first split at
+// top-level commas, each chunk is extracted on its own and the chunk
+// columns are appended in order, whole buffers at a time.
+
+typedef struct Json_columns_job {
+  const char *buf;
+  size_t begin;
+  size_t end;
+  const char **keys;
+  size_t key_count;
+  Json_columns columns;
+  int ok;
+} Json_columns_job;
+
+int column_push_validity(Json_column *column, int valid)
+{
+  if (column->length % 64 == 0) {
+    uint64_t word = 0;
+    if (!Bitmap_vector_push_back(&column->validity, &word)) {
+      return 0;
+    }
+  }
+  if (valid) {
+    column->validity.items[column->length / 64] |= (uint64_t)1 << (column->length % 64);
+  }
+  column->length++;
+  return 1;
+}
+
+// Appends count validity bits, all clear when bits is NULL. Words past the
+// last row are always clear, so whole words can be shifted in.
+int column_append_validity(Json_column *column, const uint64_t *bits, size_t count)
+{
+  if (count == 0) {
+    return 1;
+  }
+  size_t words = (column->length + count + 63) / 64;
+  size_t added = words - column->validity.size;
+  if (!Bitmap_vector_grow(&column->validity, added)) {
+    return 0;
+  }
+  memset(column->validity.items + column->validity.size, 0, added * sizeof(uint64_t));
+  column->validity.size = words;
+
+  if (bits) {
+    uint64_t *dst = column->validity.items;
+    size_t base = column->length / 64;
+    unsigned int shift = column->length % 64;
+    for (size_t w = 0; w < (count + 63) / 64; w++) {
+      dst[base + w] |= bits[w] << shift;
+      if (shift && base + w + 1 < words) {
+        dst[base + w + 1] |= bits[w] >> (64 - shift);
+      }
+    }
+  }
+  column->length += count;
+  return 1;
+}
+
+// Keeps the value buffer of the column aligned with its rows
+int column_push_placeholders(Json_column *column, size_t count)
+{
+  if (count == 0) {
+    return 1;
+  }
+  switch (column->type) {
+    case JSON_COLUMN_NULL:
+      return 1;
+    case JSON_COLUMN_BOOLEAN:
+      if (!Byte_vector_grow(&column->bools, count)) {
+        return 0;
+      }
+      memset(column->bools.items + column->bools.size, 0, count * sizeof(uint8_t));
+      column->bools.size += count;
+      return 1;
+    case JSON_COLUMN_INT64:
+      if (!Int64_vector_grow(&column->ints, count)) {
+        return 0;
+      }
+      memset(column->ints.items + column->ints.size, 0, count * sizeof(int64_t));
+      column->ints.size += count;
+      return 1;
+    case JSON_COLUMN_DOUBLE:
+      if (!Double_vector_grow(&column->doubles, count)) {
+        return 0;
+      }
+      for (size_t i = 0; i < count; i++) {
+        column->doubles.items[column->doubles.size++] = 0;
+      }
+      return 1;
+    case JSON_COLUMN_STRING:
+      if (!Size_vector_grow(&column->offsets, count)) {
+        return 0;
+      }
+      for (size_t i = 0; i < count; i++) {
+        column->offsets.items[column->offsets.size++] = column->blob.size;
+      }
+      return 1;
+  }
+  return 0;
+}
+
+int column_set_type(Json_column *column, JSON_COLUMN_TYPE type)
+{
+  column->type = type;
+  if (type == JSON_COLUMN_STRING) {
+    size_t zero = 0;
+    if (!Size_vector_push_back(&column->offsets, &zero)) {
+      return 0;
+    }
+  }
+  return column_push_placeholders(column, column->length);
+}
+
+int column_promote_to_double(Json_column *column)
+{
+  if (!Double_vector_reserve(&column->doubles, column->ints.size)) {
+    return 0;
+  }
+  for (size_t row = 0; row < column->ints.size; row++) {
+    column->doubles.items[row] = (double)column->ints.items[row];
+  }
+  column->doubles.size = column->ints.size;
+  Int64_vector_deallocate(&column->ints);
+  column->type = JSON_COLUMN_DOUBLE;
+  return 1;
+}
+
+int column_append_null(Json_column *column)
+{
+  return column_push_placeholders(column, 1) && column_push_validity(column, 0);
+}
+
+int column_append_nulls(Json_column *column, size_t count)
+{
+  return column_push_placeholders(column, count) && column_append_validity(column, NULL, count);
+}
+
+int column_append_mismatch(Json_column *column)
+{
+  column->mismatches++;
+  return column_append_null(column);
+}
+
+int column_append_bool(Json_column *column, uint8_t value)
+{
+  if (column->type == JSON_COLUMN_NULL && !column_set_type(column, JSON_COLUMN_BOOLEAN)) {
+    return 0;
+  }
+  if (column->type != JSON_COLUMN_BOOLEAN) {
+    return column_append_mismatch(column);
+  }
+  return Byte_vector_push_back(&column->bools, &value) && column_push_validity(column, 1);
+}
+
+int column_append_int64(Json_column *column, int64_t value)
+{
+  if (column->type == JSON_COLUMN_NULL && !column_set_type(column, JSON_COLUMN_INT64)) {
+    return 0;
+  }
+  if (column->type == JSON_COLUMN_DOUBLE) {
+    double d = (double)value;
+    return Double_vector_push_back(&column->doubles, &d) && column_push_validity(column, 1);
+  }
+  if (column->type != JSON_COLUMN_INT64) {
+    return column_append_mismatch(column);
+  }
+  return Int64_vector_push_back(&column->ints, &value) && column_push_validity(column, 1);
+}
+
+int column_append_double(Json_column *column, double value)
+{
+  if (column->type == JSON_COLUMN_NULL && !column_set_type(column, JSON_COLUMN_DOUBLE)) {
+    return 0;
+  }
+  if (column->type == JSON_COLUMN_INT64 && !column_promote_to_double(column)) {
+    return 0;
+  }
+  if (column->type != JSON_COLUMN_DOUBLE) {
+    return column_append_mismatch(column);
+  }
+  return Double_vector_push_back(&column->doubles, &value) && column_push_validity(column, 1);
+}
+
+int column_append_string(Json_column *column, const char *value, size_t length)
+{
+  if (column->type == JSON_COLUMN_NULL && !column_set_type(column, JSON_COLUMN_STRING)) {
+    return 0;
+  }
+  if (column->type != JSON_COLUMN_STRING) {
+    return column_append_mismatch(column);
+  }
+  return Char_vector_append(&column->blob, value, length) &&
+         Size_vector_push_back(&column->offsets, &column->blob.size) && column_push_validity(column, 1);
+}
+
+// Appends every row of src to dst, a whole buffer at a time when the types
+// agree. Values conflicting with the type of dst become mismatches.
+int column_append_column(Json_column *dst, const Json_column *src)
+{
+  size_t count = src->length;
+  int ok = 1;
+
+  dst->mismatches += src->mismatches;
+  if (src->type == JSON_COLUMN_NULL) {
+    return column_append_nulls(dst, count);
+  }
+  if (dst->type == JSON_COLUMN_NULL && !column_set_type(dst, src->type)) {
+    return 0;
+  }
+  if (dst->type == JSON_COLUMN_INT64 && src->type == JSON_COLUMN_DOUBLE && !column_promote_to_double(dst)) {
+    return 0;
+  }
+
+  if (dst->type == JSON_COLUMN_DOUBLE && src->type == JSON_COLUMN_INT64) {
+    ok = Double_vector_grow(&dst->doubles, count);
+    for (size_t row = 0; ok && row < count; row++) {
+      dst->doubles.items[dst->doubles.size++] = (double)src->ints.items[row];
+    }
+  } else if (dst->type != src->type) {
+    for (size_t row = 0; row < count; row++) {
+      dst->mismatches += !json_column_is_null(src, row);
+    }
+    return column_append_nulls(dst, count);
+  } else {
+    switch (src->type) {
+      case JSON_COLUMN_BOOLEAN:
+        ok = Byte_vector_append(&dst->bools, src->bools.items, count);
+        break;
+      case JSON_COLUMN_INT64:
+        ok = Int64_vector_append(&dst->ints, src->ints.items, count);
+        break;
+      case JSON_COLUMN_DOUBLE:
+        ok = Double_vector_append(&dst->doubles, src->doubles.items, count);
+        break;
+      case JSON_COLUMN_STRING:
+        {
+          size_t base = dst->blob.size;
+          ok = Char_vector_append(&dst->blob, src->blob.items, src->blob.size) &&
+               Size_vector_grow(&dst->offsets, count);
+          for (size_t row = 1; ok && row <= count; row++) {
+            dst->offsets.items[dst->offsets.size++] = base + src->offsets.items[row];
+          }
+        }
+        break;
+      case JSON_COLUMN_NULL:
+        break;
+    }
+  }
+  return ok && column_append_validity(dst, src->validity.items, count);
+}
+
+void column_deallocate(Json_column *column)
+{
+  free(column->name);
+  Bitmap_vector_deallocate(&column->validity);
+  Double_vector_deallocate(&column->doubles);
+  Int64_vector_deallocate(&column->ints);
+  Byte_vector_deallocate(&column->bools);
+  Size_vector_deallocate(&column->offsets);
+  Char_vector_deallocate(&column->blob);
+}
+
+// Adds a column with `rows` leading nulls
+Json_column *columns_add(Json_columns *columns, const char *name, size_t name_length, size_t rows)
+{
+  Json_column column = {0};
+  if (!slice_to_owned((Slice){.data = (char *)name, .length = name_length}, &column.name)) {
+    return NULL;
+  }
+  if (!column_append_nulls(&column, rows)) {
+    column_deallocate(&column);
+    return NULL;
+  }
+  if (!Json_column_vector_push_back(&columns->columns, &column)) {
+    column_deallocate(&column);
+    return NULL;
+  }
+  return &columns->columns.items[columns->columns.size - 1];
+}
+
+// Finds the column of a record key. Records usually list their keys in the
+// same order, so the column after the previous one is tried first.
+Json_column *columns_lookup(Json_columns *columns, const char *key, size_t key_length, size_t *hint)
+{
+  size_t count = columns->columns.size;
+  for (size_t n = 0; n < count; n++) {
+    size_t i = (*hint + n) % count;
+    Json_column *column = &columns->columns.items[i];
+    if (strlen(column->name) == key_length && memcmp(column->name, key, key_length) == 0) {
+      *hint = i + 1;
+      return column;
+    }
+  }
+  return NULL;
+}
+
+// Creates the requested columns up front, in the order given, so keys no
+// record holds still get a column of nulls
+int columns_add_keys(Json_columns *columns, const char **keys, size_t key_count)
+{
+  for (size_t i = 0; i < key_count; i++) {
+    size_t hint = 0;
+    size_t length = strlen(keys[i]);
+    if (!columns_lookup(columns, keys[i], length, &hint) && !columns_add(columns, keys[i], length, 0)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int columns_key_selected(const char **keys, size_t key_count, const char *key, size_t key_length)
+{
+  for (size_t i = 0; i < key_count; i++) {
+    if (strlen(keys[i]) == key_length && memcmp(keys[i], key, key_length) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int columns_append_value(Json_column *column, const char *s, size_t end, size_t *pos)
+{
+  size_t start = *pos;
+  char c = s[start];
+
+  if (c == '"') {
+    if (!json_skip_value(s, end, pos)) {
+      return 0;
+    }
+    return column_append_string(column, s + start + 1, *pos - start - 2);
+  } else if (c == '{' || c == '[') {
+    if (!json_skip_value(s, end, pos)) {
+      return 0;
+    }
+    return column_append_string(column, s + start, *pos - start);
+  }
+
+  size_t i = start;
+  while (i < end && !json_is_space(s[i]) && s[i] != ',' && s[i] != '}' && s[i] != ']') {
+    i++;
+  }
+  *pos = i;
+
+  size_t length = i - start;
+  if (length == 4 && memcmp(s + start, "null", 4) == 0) {
+    return column_append_null(column);
+  } else if (length == 4 && memcmp(s + start, "true", 4) == 0) {
+    return column_append_bool(column, 1);
+  } else if (length == 5 && memcmp(s + start, "false", 5) == 0) {
+    return column_append_bool(column, 0);
+  }
+
+  char buffer[64];
+  char *number_end;
+  if (length == 0 || length >= sizeof(buffer)) {
+    return column_append_mismatch(column);
+  }
+  memcpy(buffer, s + start, length);
+  buffer[length] = '\0';
+  if (!memchr(buffer, '.', length) && !memchr(buffer, 'e', length) && !memchr(buffer, 'E', length)) {
+    errno = 0;
+    long long value = strtoll(buffer, &number_end, 10);
+    if (number_end == buffer + length && errno != ERANGE) {
+      return column_append_int64(column, (int64_t)value);
+    }
+  }
+  double value = strtod(buffer, &number_end);
+  if (number_end != buffer + length) {
+    return column_append_mismatch(column);
+  }
+  return column_append_double(column, value);
+}
+
+#define SKIP_SPACE() while (pos < end && json_is_space(s[pos])) pos++
+
+// Extracts the records in s[begin, end), a comma separated run of array elements
+int columns_extract_range(const char *s, size_t begin, size_t end, const char **keys, size_t key_count,
+                          Json_columns *out)
+{
+  size_t pos = begin;
+  size_t hint = 0;
+
+  for (;;) {
+    SKIP_SPACE();
+    if (pos >= end || s[pos] == ']') {
+      return 1;
+    }
+    if (s[pos] == ',') {
+      pos++;
+      continue;
+    }
+    if (s[pos] != '{') {
+      fprintf(stderr, "ERROR! Expected an object record at byte %zu\n", pos);
+      return 0;
+    }
+    pos++;
+
+    size_t row = out->rows;
+    for (;;) {
+      SKIP_SPACE();
+      if (pos < end && s[pos] == '}') {
+        pos++;
+        break;
+      }
+      if (pos < end && s[pos] == ',') {
+        pos++;
+        continue;
+      }
+      if (pos >= end || s[pos] != '"') {
+        fprintf(stderr, "ERROR! Expected a key at byte %zu\n", pos);
+        return 0;
+      }
+
+      size_t key = pos + 1;
+      if (!json_skip_value(s, end, &pos)) {
+        return 0;
+      }
+      size_t key_length = pos - key - 1;
+      SKIP_SPACE();
+      if (pos >= end || s[pos] != ':') {
+        fprintf(stderr, "ERROR! Expected ':' at byte %zu\n", pos);
+        return 0;
+      }
+      pos++;
+      SKIP_SPACE();
+      if (pos >= end) {
+        return 0;
+      }
+
+      Json_column *column = columns_lookup(out, s + key, key_length, &hint);
+      if (!column && (!keys || columns_key_selected(keys, key_count, s + key, key_length))) {
+        column = columns_add(out, s + key, key_length, row);
+        if (!column) {
+          return 0;
+        }
+        hint = out->columns.size;
+      }
+
+      if (column && column->length == row) {
+        if (!columns_append_value(column, s, end, &pos)) {
+          return 0;
+        }
+      } else {
+        // Not selected, or a duplicate key within the record
+        if (!json_skip_value(s, end, &pos)) {
+          return 0;
+        }
+      }
+    }
+
+    out->rows++;
+    for (size_t i = 0; i < out->columns.size; i++) {
+      if (out->columns.items[i].length < out->rows && !column_append_null(&out->columns.items[i])) {
+        return 0;
+      }
+    }
+  }
+}
+
+#undef SKIP_SPACE
+
+void *columns_job_run(void *arg)
+{
+  Json_columns_job *job = (Json_columns_job *)arg;
+  // ok is already 0 when the requested columns couldn't be created
+  job->ok = job->ok && columns_extract_range(job->buf, job->begin, job->end, job->keys, job->key_count, &job->columns);
+  return NULL;
+}
+
+// Splits the array elements after `begin` into at most `count` chunks of
+// similar size, returns the number of chunks
+size_t columns_split(const char *s, size_t begin, size_t length, size_t count, size_t *bounds)
+{
+  size_t chunk = (length - begin) / count + 1;
+  size_t n = 1;
+  size_t depth = 0;
+
+  bounds[0] = begin;
+  for (size_t i = begin; i < length; i++) {
+    char c = s[i];
+    if (c == '"') {
+      for (i++; i < length && s[i] != '"'; i++) {
+        if (s[i] == '\\') {
+          i++;
+        }
+      }
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        length = i;
+        break;
+      }
+      depth--;
+    } else if (c == ',' && depth == 0 && n < count && i >= begin + n * chunk) {
+      bounds[n++] = i + 1;
+    }
+  }
+  bounds[n] = length;
+  return n;
+}
+
+int columns_merge(Json_columns *out, Json_columns_job *jobs, size_t count)
+{
+  for (size_t j = 0; j < count; j++) {
+    Json_columns *part = &jobs[j].columns;
+    size_t hint = 0;
+
+    for (size_t i = 0; i < part->columns.size; i++) {
+      Json_column *column = &part->columns.items[i];
+      if (!columns_lookup(out, column->name, strlen(column->name), &hint) &&
+          !columns_add(out, column->name, strlen(column->name), out->rows)) {
+        return 0;
+      }
+    }
+
+    for (size_t i = 0; i < out->columns.size; i++) {
+      Json_column *dst = &out->columns.items[i];
+      Json_column *src = columns_lookup(part, dst->name, strlen(dst->name), &hint);
+      if (!(src ? column_append_column(dst, src) : column_append_nulls(dst, part->rows))) {
+        return 0;
+      }
+    }
+    out->rows += part->rows;
+  }
+  return 1;
+}
+
+// Extracts a JSON array of objects into one column per key. With keys set
+// exactly those columns are built, in the order given, whether or not any
+// record holds them; otherwise every key found becomes a column.
+int json_columns_extract(const char *buf, size_t length, const char **keys, size_t key_count,
+                         size_t threads, Json_columns *out)
+{
+  size_t pos = 0;
+
+  out->rows = 0;
+  if (!Json_column_vector_new(&out->columns, 8) || !columns_add_keys(out, keys, keys ? key_count : 0)) {
+    return 0;
+  }
+
+  while (pos < length && json_is_space(buf[pos])) {
+    pos++;
+  }
+  if (pos >= length || buf[pos] != '[') {
+    fprintf(stderr, "ERROR! Expected an array of records\n");
+    return 0;
+  }
+  pos++;
+
+  if (threads > JSON_COLUMNS_MAX_THREADS) {
+    threads = JSON_COLUMNS_MAX_THREADS;
+  }
+  if (threads <= 1 || length < threads * 65536) {
+    return columns_extract_range(buf, pos, length, keys, key_count, out);
+  }
+
+  size_t bounds[JSON_COLUMNS_MAX_THREADS + 1];
+  size_t count = columns_split(buf, pos, length, threads, bounds);
+  Json_columns_job jobs[JSON_COLUMNS_MAX_THREADS];
+  pthread_t ids[JSON_COLUMNS_MAX_THREADS];
+  int started[JSON_COLUMNS_MAX_THREADS] = {0};
+
+  for (size_t i = 0; i < count; i++) {
+    jobs[i] = (Json_columns_job){
+      .buf = buf, .begin = bounds[i], .end = bounds[i + 1], .keys = keys, .key_count = key_count
+    };
+    Json_column_vector_new(&jobs[i].columns.columns, 8);
+    jobs[i].ok = columns_add_keys(&jobs[i].columns, keys, keys ? key_count : 0);
+  }
+  for (size_t i = 1; i < count; i++) {
+    started[i] = pthread_create(&ids[i], NULL, columns_job_run, &jobs[i]) == 0;
+    if (!started[i]) {
+      columns_job_run(&jobs[i]);
+    }
+  }
+  columns_job_run(&jobs[0]);
+
+  int ok = 1;
+  for (size_t i = 0; i < count; i++) {
+    if (started[i]) {
+      pthread_join(ids[i], NULL);
+    }
+    ok &= jobs[i].ok;
+  }
+
+  ok = ok && columns_merge(out, jobs, count);
+  for (size_t i = 0; i < count; i++) {
+    json_columns_deallocate(&jobs[i].columns);
+  }
+  return ok;
+}
+
+Json_column *json_columns_find(Json_columns *columns, const char *name)
+{
+  size_t hint = 0;
+  return columns_lookup(columns, name, strlen(name), &hint);
+}
+
+void json_columns_deallocate(Json_columns *columns)
+{
+  for (size_t i = 0; i < columns->columns.size; i++) {
+    column_deallocate(&columns->columns.items[i]);
+  }
+  Json_column_vector_deallocate(&columns->columns);
+  columns->rows = 0;
+}
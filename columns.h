@@ -0,0 +1,67 @@
+#ifndef __COLUMNS__
+#define __COLUMNS__
+
+#include <stdint.h>
+
+#include "uds.h"
+
+VECTOR_DECLARE(Double_vector, double)
+VECTOR_DEFINE(Double_vector, double)
+VECTOR_DECLARE(Int64_vector, int64_t)
+VECTOR_DEFINE(Int64_vector, int64_t)
+VECTOR_DECLARE(Byte_vector, uint8_t)
+VECTOR_DEFINE(Byte_vector, uint8_t)
+VECTOR_DECLARE(Size_vector, size_t)
+VECTOR_DEFINE(Size_vector, size_t)
+VECTOR_DECLARE(Char_vector, char)
+VECTOR_DEFINE(Char_vector, char)
+VECTOR_DECLARE(Bitmap_vector, uint64_t)
+VECTOR_DEFINE(Bitmap_vector, uint64_t)
+
+#define JSON_COLUMNS_MAX_THREADS 64
+
+typedef enum {
+  JSON_COLUMN_NULL, // Only nulls seen so far
+  JSON_COLUMN_BOOLEAN,
+  JSON_COLUMN_INT64,
+  JSON_COLUMN_DOUBLE,
+  JSON_COLUMN_STRING
+} JSON_COLUMN_TYPE;
+
+// One field across all records. The type comes from the first non-null
+// value; integer columns are promoted to double when a fraction shows up,
+// other conflicting values are stored as null and counted in mismatches.
+// Strings keep their escapes, nested objects and arrays are stored as their
+// JSON text in string columns.
+typedef struct Json_column {
+  char *name;
+  JSON_COLUMN_TYPE type;
+  size_t length;
+  Bitmap_vector validity; // Bit i is set when row i holds a value
+  Double_vector doubles;  // JSON_COLUMN_DOUBLE
+  Int64_vector ints;      // JSON_COLUMN_INT64
+  Byte_vector bools;      // JSON_COLUMN_BOOLEAN
+  Size_vector offsets;    // JSON_COLUMN_STRING, length + 1 offsets into blob
+  Char_vector blob;
+  size_t mismatches;
+} Json_column;
+
+VECTOR_DECLARE(Json_column_vector, Json_column)
+VECTOR_DEFINE(Json_column_vector, Json_column)
+
+typedef struct Json_columns {
+  Json_column_vector columns;
+  size_t rows;
+} Json_columns;
+
+int json_columns_extract(const char *buf, size_t length, const char **keys, size_t key_count,
+                         size_t threads, Json_columns *out);
+Json_column *json_columns_find(Json_columns *columns, const char *name);
+void json_columns_deallocate(Json_columns *columns);
+
+static inline int json_column_is_null(const Json_column *column, size_t row)
+{
+  return !((column->validity.items[row / 64] >> (row % 64)) & 1);
+}
+
+#endif // __COLUMNS__
@@ -0,0 +1,689 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "daemon.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "stream.h"
+
+// The event loop owns the sockets: it accepts, reads requests into the
+// connection's input and queues the connection once it holds a complete
+// line. A worker then answers every complete line of that connection in
+// order, so a connection is never held by two workers at once. Responses
+// are sent by the worker as far as the socket takes them; the rest is left
+// to the event loop through EPOLLOUT. Only the event loop frees
+// connections, after the worker holding one let go of it.
+
+struct Json_document {
+  const char *path;            // The map's key
+  pthread_rwlock_t lock;       // Read locked while querying, write locked to swap object
+  pthread_mutex_t reload_lock; // One reload of a document at a time
+  atomic_int reload_queued;    // Waiting in the daemon's reloads queue
+  Json_object object;
+  int loaded;                  // object holds a parsed version
+  int checked;                 // The fields below were set by a load attempt
+  dev_t device;                // File state of the last load attempt
+  ino_t inode;
+  off_t size;
+  struct timespec mtime;
+};
+
+HASHMAP_DEFINE(Json_document_map, char *, Json_document *, string_hash, string_compare)
+
+struct Json_connection {
+  Json_connection *prev; // In the daemon's list of open connections
+  Json_connection *next;
+  int fd;
+  pthread_mutex_t lock;
+  Vector input;  // char, requests not answered yet
+  Vector output; // char, responses not sent yet
+  int scheduled; // Queued for or held by a worker
+  int closing;
+  int writing;   // EPOLLOUT is armed
+};
+
+int daemon_document_current(Json_document *document, const struct stat *st)
+{
+  return document->device == st->st_dev && document->inode == st->st_ino && document->size == st->st_size &&
+         document->mtime.tv_sec == st->st_mtim.tv_sec && document->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// Compressed documents are decompressed while they are parsed. Numbers
+// are parsed eagerly so concurrent readers never write to the tree.
+int daemon_load(const char *path, Json_object *object)
+{
+  json_parser parser = {.flags = JSON_PARSE_PACK_ARRAYS};
+  Json_stream stream;
+
+  memset(object, 0, sizeof(*object));
+  if (!json_stream_open(&stream, path)) {
+    return 0;
+  }
+  int ok = json_parse_stream(&parser, &stream, object);
+  ok &= json_stream_close(&stream);
+  if (!ok) {
+    json_unload(object);
+  }
+  return ok;
+}
+
+void daemon_document_free(Json_document *document)
+{
+  if (document->loaded) {
+    json_unload(&document->object);
+  }
+  pthread_rwlock_destroy(&document->lock);
+  pthread_mutex_destroy(&document->reload_lock);
+  free(document);
+}
+
+Json_document *daemon_document_new(void)
+{
+  Json_document *document = (Json_document *)calloc(1, sizeof(Json_document));
+  if (!document) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for document\n");
+    return NULL;
+  }
+  pthread_rwlock_init(&document->lock, NULL);
+  pthread_mutex_init(&document->reload_lock, NULL);
+  return document;
+}
+
+// Documents are served from the set the daemon was started with, so the
+// map never changes while workers run and is read without a lock
+int daemon_document_add(Json_daemon *daemon, const char *path)
+{
+  char *key;
+  int created;
+  if (Json_document_map_search(&daemon->documents, (char *)path)) {
+    return 1;
+  }
+  Json_document *document = daemon_document_new();
+  if (!document || !slice_to_owned(_slice((char *)path), &key)) {
+    if (document) {
+      daemon_document_free(document);
+    }
+    return 0;
+  }
+  Json_document **slot = Json_document_map_emplace(&daemon->documents, key, &created);
+  if (!slot) {
+    free(key);
+    daemon_document_free(document);
+    return 0;
+  }
+  *slot = document;
+  document->path = key;
+  return 1;
+}
+
+// Parses the document again if its file changed since the last attempt.
+// A document that fails to parse after a change keeps serving its previous
+// version. Failures are only retried once the file changes again.
+void daemon_reload(Json_daemon *daemon, Json_document *document)
+{
+  struct stat st;
+  pthread_mutex_lock(&document->reload_lock);
+  if (stat(document->path, &st) != 0 || !S_ISREG(st.st_mode)) {
+    pthread_mutex_unlock(&document->reload_lock);
+    return;
+  }
+  pthread_rwlock_rdlock(&document->lock);
+  int current = document->checked && daemon_document_current(document, &st);
+  pthread_rwlock_unlock(&document->lock);
+
+  if (!current) {
+    Json_object object;
+    int ok = daemon_load(document->path, &object);
+    if (!ok) {
+      fprintf(stderr, "ERROR! Couldn't load document %s\n", document->path);
+    }
+
+    pthread_rwlock_wrlock(&document->lock);
+    Json_object old = document->object;
+    int replaced = ok && document->loaded;
+    if (ok) {
+      document->object = object;
+      document->loaded = 1;
+    }
+    document->device = st.st_dev;
+    document->inode = st.st_ino;
+    document->size = st.st_size;
+    document->mtime = st.st_mtim;
+    document->checked = 1;
+    pthread_rwlock_unlock(&document->lock);
+
+    if (replaced) {
+      json_unload_deferred(&daemon->reclaimer, &old);
+    }
+  }
+  pthread_mutex_unlock(&document->reload_lock);
+}
+
+// Reloads changed documents off the request path, workers keep answering
+// from the previous version until the new one is swapped in
+void *daemon_reloader(void *arg)
+{
+  Json_daemon *daemon = (Json_daemon *)arg;
+  void *item;
+
+  while (queue_pop(&daemon->reloads, &item)) {
+    Json_document *document = (Json_document *)item;
+    // Cleared first, so a change made during the reload queues another
+    atomic_store(&document->reload_queued, 0);
+    daemon_reload(daemon, document);
+  }
+  return NULL;
+}
+
+// Returns the document at path. A changed document is reloaded in the
+// background while its current version is served; only a document with
+// no version yet is loaded on the caller's thread.
+Json_document *daemon_document(Json_daemon *daemon, const char *path, const char **error)
+{
+  Json_document **slot = Json_document_map_search(&daemon->documents, (char *)path);
+  if (!slot) {
+    *error = "unknown document";
+    return NULL;
+  }
+  Json_document *document = *slot;
+
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+    *error = "document isn't a readable file";
+    return NULL;
+  }
+
+  pthread_rwlock_rdlock(&document->lock);
+  int current = document->checked && daemon_document_current(document, &st);
+  int loaded = document->loaded;
+  pthread_rwlock_unlock(&document->lock);
+
+  if (!current && !loaded) {
+    daemon_reload(daemon, document);
+  } else if (!current && !atomic_exchange(&document->reload_queued, 1)) {
+    // Each document is queued at most once, so the queue never fills
+    queue_push(&daemon->reloads, document);
+  }
+  return document;
+}
+
+int daemon_write_error(Vector *out, const char *message)
+{
+  return vector_append(out, "ERR ", 4) && vector_append(out, (void *)message, strlen(message)) &&
+         vector_append(out, "\n", 1);
+}
+
+// Appends the response to one request line, NUL-terminating its fields in place
+int daemon_answer(Json_daemon *daemon, char *request, Vector *out)
+{
+  int key_lookup;
+  char *document_path;
+  if (strncmp(request, "QUERY ", 6) == 0) {
+    key_lookup = 0;
+    document_path = request + 6;
+  } else if (strncmp(request, "KEY ", 4) == 0) {
+    key_lookup = 1;
+    document_path = request + 4;
+  } else {
+    return daemon_write_error(out, "unknown request");
+  }
+  char *argument = strchr(document_path, '\t');
+  if (!argument) {
+    return daemon_write_error(out, "expected <document>\\t<argument>");
+  }
+  *argument++ = '\0';
+
+  const char *error;
+  Json_document *document = daemon_document(daemon, document_path, &error);
+  if (!document) {
+    return daemon_write_error(out, error);
+  }
+
+  pthread_rwlock_rdlock(&document->lock);
+  int ok;
+  if (!document->loaded) {
+    ok = daemon_write_error(out, "document couldn't be parsed");
+  } else {
+    Json_node *root = &document->object.root;
+    Json_node scratch;
+    Json_node *value = NULL;
+    if (key_lookup) {
+      value = root->type == JSON_NODE_OBJECT ? Json_node_map_search(&root->map, argument) : NULL;
+    } else if (!json_query_at(root, argument, &scratch, &value)) {
+      value = NULL;
+    }
+    if (value) {
+      ok = vector_append(out, "OK ", 3) && json_write(out, value) && vector_append(out, "\n", 1);
+    } else {
+      ok = vector_append(out, "MISSING\n", 8);
+    }
+  }
+  pthread_rwlock_unlock(&document->lock);
+  return ok;
+}
+
+// Sends what the socket takes right now, called with the connection locked
+void daemon_flush(Json_connection *connection)
+{
+  size_t sent = 0;
+  while (sent < connection->output.size) {
+    ssize_t n = send(connection->fd, (char *)connection->output.items + sent, connection->output.size - sent,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n < 0) {
+      sent = connection->output.size; // The peer is gone, the event loop sees the hang up
+      break;
+    }
+    sent += (size_t)n;
+  }
+  memmove(connection->output.items, (char *)connection->output.items + sent, connection->output.size - sent);
+  connection->output.size -= sent;
+}
+
+// Called with the connection locked. Keeps EPOLLOUT armed only while
+// output is pending.
+void daemon_watch_output(Json_daemon *daemon, Json_connection *connection)
+{
+  int writing = connection->output.size > 0;
+  if (writing != connection->writing && !connection->closing) {
+    struct epoll_event event = {.events = EPOLLIN | (writing ? EPOLLOUT : 0), .data.ptr = connection};
+    epoll_ctl(daemon->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->writing = writing;
+  }
+}
+
+// Called with the connection locked. Requests wait while too much output
+// is pending; the event loop reschedules the connection once it drained.
+int daemon_has_request(Json_connection *connection)
+{
+  return !connection->closing && connection->output.size < JSON_DAEMON_MAX_OUTPUT &&
+         memchr(connection->input.items, '\n', connection->input.size) != NULL;
+}
+
+void *daemon_worker(void *arg)
+{
+  Json_daemon *daemon = (Json_daemon *)arg;
+  char request[JSON_DAEMON_MAX_REQUEST + 1];
+  Vector response;
+  void *item;
+
+  if (!vector_new(&response, 1, 4096)) {
+    return NULL;
+  }
+  while (queue_pop(&daemon->ready, &item)) {
+    Json_connection *connection = (Json_connection *)item;
+
+    pthread_mutex_lock(&connection->lock);
+    while (daemon_has_request(connection)) {
+      char *input = (char *)connection->input.items;
+      size_t length = (char *)memchr(input, '\n', connection->input.size) - input;
+      memcpy(request, input, length); // The event loop caps lines at JSON_DAEMON_MAX_REQUEST
+      request[length] = '\0';
+      if (length > 0 && request[length - 1] == '\r') {
+        request[length - 1] = '\0';
+      }
+      memmove(input, input + length + 1, connection->input.size - length - 1);
+      connection->input.size -= length + 1;
+      pthread_mutex_unlock(&connection->lock);
+
+      response.size = 0;
+      if (!daemon_answer(daemon, request, &response)) {
+        response.size = 0;
+        daemon_write_error(&response, "out of memory");
+      }
+
+      pthread_mutex_lock(&connection->lock);
+      if (!connection->closing && vector_append(&connection->output, response.items, response.size)) {
+        daemon_flush(connection);
+        daemon_watch_output(daemon, connection);
+      }
+    }
+    connection->scheduled = 0;
+    pthread_mutex_unlock(&connection->lock);
+  }
+  vector_deallocate(&response);
+  return NULL;
+}
+
+// Called with the connection locked
+void daemon_schedule(Json_daemon *daemon, Json_connection *connection)
+{
+  if (!connection->scheduled && daemon_has_request(connection)) {
+    connection->scheduled = 1;
+    if (!queue_try_push(&daemon->ready, connection)) {
+      // Every worker is behind, wait for one without holding the connection
+      pthread_mutex_unlock(&connection->lock);
+      queue_push(&daemon->ready, connection);
+      pthread_mutex_lock(&connection->lock);
+    }
+  }
+}
+
+void daemon_connection_free(Json_connection *connection)
+{
+  close(connection->fd);
+  vector_deallocate(&connection->input);
+  vector_deallocate(&connection->output);
+  pthread_mutex_destroy(&connection->lock);
+  free(connection);
+}
+
+// Stops watching the connection; it's freed once no worker holds it
+void daemon_close(Json_daemon *daemon, Json_connection *connection)
+{
+  if (connection->prev) {
+    connection->prev->next = connection->next;
+  } else {
+    daemon->connections = connection->next;
+  }
+  if (connection->next) {
+    connection->next->prev = connection->prev;
+  }
+  epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+  pthread_mutex_lock(&connection->lock);
+  connection->closing = 1;
+  pthread_mutex_unlock(&connection->lock);
+  if (!vector_push_back(&daemon->closing, &connection)) {
+    // Leaked rather than freed under a worker
+    fprintf(stderr, "ERROR! Couldn't track closing connection\n");
+  }
+}
+
+void daemon_reap(Json_daemon *daemon)
+{
+  size_t kept = 0;
+  Json_connection **closing = (Json_connection **)daemon->closing.items;
+  for (size_t i = 0; i < daemon->closing.size; i++) {
+    pthread_mutex_lock(&closing[i]->lock);
+    int held = closing[i]->scheduled;
+    pthread_mutex_unlock(&closing[i]->lock);
+    if (held) {
+      closing[kept++] = closing[i];
+    } else {
+      daemon_connection_free(closing[i]);
+    }
+  }
+  daemon->closing.size = kept;
+}
+
+void daemon_accept(Json_daemon *daemon)
+{
+  for (;;) {
+    int fd = accept(daemon->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("accept");
+      }
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    Json_connection *connection = (Json_connection *)calloc(1, sizeof(Json_connection));
+    if (!connection || !vector_new(&connection->input, 1, 256) || !vector_new(&connection->output, 1, 4096)) {
+      fprintf(stderr, "ERROR! Couldn't allocate memory for connection\n");
+      if (connection) {
+        vector_deallocate(&connection->input);
+      }
+      free(connection);
+      close(fd);
+      continue;
+    }
+    connection->fd = fd;
+    pthread_mutex_init(&connection->lock, NULL);
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+    if (epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      perror("epoll_ctl");
+      daemon_connection_free(connection);
+      continue;
+    }
+    connection->next = daemon->connections;
+    if (daemon->connections) {
+      daemon->connections->prev = connection;
+    }
+    daemon->connections = connection;
+  }
+}
+
+// Returns 0 when the connection has to be closed
+int daemon_read(Json_daemon *daemon, Json_connection *connection)
+{
+  char buffer[16384];
+  int open = 1;
+
+  for (;;) {
+    ssize_t n = read(connection->fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n <= 0) {
+      open = 0;
+      break;
+    }
+
+    pthread_mutex_lock(&connection->lock);
+    int ok = vector_append(&connection->input, buffer, (size_t)n);
+    // A line that doesn't end within the limit can't be a valid request
+    size_t start = 0;
+    char *input = (char *)connection->input.items;
+    for (char *newline; ok && (newline = memchr(input + start, '\n', connection->input.size - start));) {
+      ok = (size_t)(newline - input) - start <= JSON_DAEMON_MAX_REQUEST;
+      start = (size_t)(newline - input) + 1;
+    }
+    ok = ok && connection->input.size - start <= JSON_DAEMON_MAX_REQUEST;
+    if (ok) {
+      daemon_schedule(daemon, connection);
+    }
+    pthread_mutex_unlock(&connection->lock);
+    if (!ok) {
+      open = 0;
+      break;
+    }
+  }
+  return open;
+}
+
+void daemon_write(Json_daemon *daemon, Json_connection *connection)
+{
+  pthread_mutex_lock(&connection->lock);
+  daemon_flush(connection);
+  daemon_watch_output(daemon, connection);
+  daemon_schedule(daemon, connection);
+  pthread_mutex_unlock(&connection->lock);
+}
+
+int json_daemon_start(Json_daemon *daemon, const char *socket_path, size_t workers, const char **documents,
+                      size_t document_count)
+{
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+  memset(daemon, 0, sizeof(*daemon));
+  daemon->listen_fd = -1;
+  daemon->epoll_fd = -1;
+  if (workers == 0 || strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "ERROR! A daemon needs a worker and a socket path shorter than %zu bytes\n",
+            sizeof(address.sun_path));
+    return 0;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  if (!slice_to_owned(_slice((char *)socket_path), &daemon->socket_path)) {
+    return 0;
+  }
+  Json_document_map_new(&daemon->documents);
+  if (!vector_new(&daemon->closing, sizeof(Json_connection *), 16) ||
+      !queue_new(&daemon->ready, JSON_DAEMON_QUEUE) ||
+      !queue_new(&daemon->reloads, document_count > 0 ? document_count : 1)) {
+    free(daemon->socket_path);
+    vector_deallocate(&daemon->closing);
+    queue_deallocate(&daemon->ready);
+    return 0;
+  }
+  for (size_t i = 0; i < document_count; i++) {
+    if (!daemon_document_add(daemon, documents[i])) {
+      fprintf(stderr, "ERROR! Couldn't allocate memory for document %s\n", documents[i]);
+      json_daemon_stop(daemon);
+      return 0;
+    }
+  }
+
+  // Replace a socket file left behind by a daemon that didn't stop cleanly,
+  // but not the socket of one that is still serving
+  int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0) {
+    fprintf(stderr, "ERROR! Another daemon is serving %s\n", socket_path);
+    close(probe);
+    json_daemon_stop(daemon);
+    return 0;
+  }
+  if (probe >= 0) {
+    close(probe);
+  }
+  unlink(socket_path);
+  daemon->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  daemon->epoll_fd = epoll_create1(0);
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+  if (daemon->listen_fd < 0 || daemon->epoll_fd < 0 ||
+      bind(daemon->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(daemon->listen_fd, SOMAXCONN) != 0 ||
+      fcntl(daemon->listen_fd, F_SETFL, fcntl(daemon->listen_fd, F_GETFL) | O_NONBLOCK) != 0 ||
+      epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->listen_fd, &event) != 0) {
+    fprintf(stderr, "ERROR! Couldn't listen on %s: %s\n", socket_path, strerror(errno));
+    json_daemon_stop(daemon);
+    return 0;
+  }
+
+  // Signals are left to the thread running the event loop
+  sigset_t blocked, previous;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+  int ok = json_reclaimer_start(&daemon->reclaimer, 1, 16);
+  daemon->reloader_started = ok && pthread_create(&daemon->reloader, NULL, daemon_reloader, daemon) == 0;
+  daemon->workers = ok ? (pthread_t *)malloc(workers * sizeof(pthread_t)) : NULL;
+  for (size_t i = 0; daemon->workers && i < workers; i++) {
+    if (pthread_create(&daemon->workers[daemon->worker_count], NULL, daemon_worker, daemon) == 0) {
+      daemon->worker_count++;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  if (daemon->worker_count == 0 || !daemon->reloader_started) {
+    fprintf(stderr, "ERROR! Couldn't start daemon workers\n");
+    json_daemon_stop(daemon);
+    return 0;
+  }
+
+  // Parsed up front so the first queries don't wait. A document that
+  // can't be read yet is tried again when it's asked for.
+  for (size_t i = 0; i < document_count; i++) {
+    const char *error;
+    if (!daemon_document(daemon, documents[i], &error)) {
+      fprintf(stderr, "ERROR! Document %s: %s\n", documents[i], error);
+    }
+  }
+  return 1;
+}
+
+// Serves until *stop is set, by a signal handler for instance
+int json_daemon_run(Json_daemon *daemon, volatile sig_atomic_t *stop)
+{
+  struct epoll_event events[JSON_DAEMON_MAX_EVENTS];
+
+  while (!*stop) {
+    // Connections waiting for their worker are checked again shortly
+    int n = epoll_wait(daemon->epoll_fd, events, JSON_DAEMON_MAX_EVENTS, daemon->closing.size ? 10 : 500);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      return 0;
+    }
+    for (int i = 0; i < n; i++) {
+      Json_connection *connection = (Json_connection *)events[i].data.ptr;
+      if (!connection) {
+        daemon_accept(daemon);
+        continue;
+      }
+      int open = 1;
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        open = daemon_read(daemon, connection);
+      }
+      if (open && (events[i].events & EPOLLOUT)) {
+        daemon_write(daemon, connection);
+      }
+      if (!open) {
+        daemon_close(daemon, connection);
+      }
+    }
+    daemon_reap(daemon);
+  }
+  return 1;
+}
+
+void json_daemon_stop(Json_daemon *daemon)
+{
+  queue_close(&daemon->ready);
+  for (size_t i = 0; i < daemon->worker_count; i++) {
+    pthread_join(daemon->workers[i], NULL);
+  }
+  free(daemon->workers);
+  daemon->workers = NULL;
+  daemon->worker_count = 0;
+
+  // The reloader finishes the reloads already queued, then exits
+  queue_close(&daemon->reloads);
+  if (daemon->reloader_started) {
+    pthread_join(daemon->reloader, NULL);
+    daemon->reloader_started = 0;
+  }
+  queue_deallocate(&daemon->reloads);
+
+  // Connections still queued were never picked up
+  void *item;
+  while (queue_pop(&daemon->ready, &item)) {
+    ((Json_connection *)item)->scheduled = 0;
+  }
+  while (daemon->connections) {
+    daemon_close(daemon, daemon->connections);
+  }
+  daemon_reap(daemon);
+  vector_deallocate(&daemon->closing);
+  queue_deallocate(&daemon->ready);
+
+  if (daemon->epoll_fd >= 0) {
+    close(daemon->epoll_fd);
+  }
+  if (daemon->listen_fd >= 0) {
+    close(daemon->listen_fd);
+    unlink(daemon->socket_path);
+    daemon->listen_fd = -1;
+  }
+  free(daemon->socket_path);
+
+  for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+    for (Json_document_mapEntry *entry = daemon->documents.buckets[i]; entry; entry = entry->next) {
+      free(entry->key);
+      daemon_document_free(entry->value);
+    }
+  }
+  Json_document_map_deallocate(&daemon->documents);
+  if (daemon->reclaimer.threads) {
+    json_reclaimer_stop(&daemon->reclaimer);
+  }
+}
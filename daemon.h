@@ -0,0 +1,55 @@
+#ifndef __DAEMON__
+#define __DAEMON__
+
+#include <signal.h>
+
+#include "json.h"
+#include "reclaim.h"
+
+#define JSON_DAEMON_MAX_EVENTS 64
+#define JSON_DAEMON_MAX_REQUEST 4096     // Longer request lines close the connection
+#define JSON_DAEMON_MAX_OUTPUT (1 << 24) // Unsent bytes after which a connection's requests wait
+#define JSON_DAEMON_QUEUE 1024           // Connections waiting for a worker
+
+// Line protocol over a UNIX stream socket. Requests, fields separated by a
+// tab, no tabs or newlines inside them:
+//   QUERY <document>\t<path>   value at a json_query path
+//   KEY <document>\t<key>      value of a top-level key, like json_search_key
+// Each request is answered in order with one line:
+//   OK <value as minified JSON>
+//   MISSING
+//   ERR <message>
+// <document> is one of the file paths the daemon was started with, spelled
+// the same way; any other path is answered with ERR. Documents are parsed
+// at start and parsed again whenever their mtime, size or inode change, so
+// memory stays bounded by the set the daemon serves. A reload runs in the
+// background; requests are answered from the previous version until the
+// new one has parsed.
+
+typedef struct Json_document Json_document;
+typedef struct Json_connection Json_connection;
+
+HASHMAP_DECLARE(Json_document_map, char *, Json_document *)
+
+typedef struct Json_daemon {
+  char *socket_path;
+  int listen_fd;
+  int epoll_fd;
+  Queue ready;                    // Json_connection * with complete requests
+  pthread_t *workers;
+  size_t worker_count;
+  Json_document_map documents;    // Filled by json_daemon_start, then only read
+  Queue reloads;                  // Json_document * whose file changed
+  pthread_t reloader;             // Parses changed documents, then swaps them in
+  int reloader_started;
+  Json_reclaimer reclaimer;       // Frees documents replaced by a reload
+  Json_connection *connections;   // Open ones, linked through the connections
+  Vector closing;                 // Json_connection *, freed once no worker holds them
+} Json_daemon;
+
+int json_daemon_start(Json_daemon *daemon, const char *socket_path, size_t workers, const char **documents,
+                      size_t document_count);
+int json_daemon_run(Json_daemon *daemon, volatile sig_atomic_t *stop);
+void json_daemon_stop(Json_daemon *daemon);
+
+#endif // __DAEMON__
@@ -0,0 +1,189 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "client.h"
+
+#define DAEMON_BENCH_MAX_CLIENTS 256
+
+// Load test for json_daemon: every client thread keeps one query in flight
+// on its own connection for the whole run. With --reload the document's
+// mtime is bumped periodically, so queries race with reloads and with the
+// teardown of the versions they replace.
+
+typedef struct Bench_client {
+  const char *socket_path;
+  const char *document;
+  const char *path;
+  double deadline;
+  Vector latencies; // uint64_t, nanoseconds
+  size_t errors;
+} Bench_client;
+
+double now_seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void *bench_client(void *arg)
+{
+  Bench_client *bench = (Bench_client *)arg;
+  Json_client client;
+  Vector out;
+
+  if (!vector_new(&out, 1, 4096)) {
+    return NULL;
+  }
+  if (!json_client_connect(&client, bench->socket_path)) {
+    bench->errors++;
+    vector_deallocate(&out);
+    return NULL;
+  }
+  for (;;) {
+    double start = now_seconds();
+    if (start >= bench->deadline) {
+      break;
+    }
+    out.size = 0;
+    // Only answered queries are timed, MISSING and ERR count as errors
+    if (!json_client_query(&client, bench->document, bench->path, &out)) {
+      bench->errors++;
+      if (client.fd < 0) {
+        break;
+      }
+      continue;
+    }
+    uint64_t latency = (uint64_t)((now_seconds() - start) * 1e9);
+    vector_push_back(&bench->latencies, &latency);
+  }
+  json_client_close(&client);
+  vector_deallocate(&out);
+  return NULL;
+}
+
+typedef struct Bench_reloader {
+  const char *document;
+  double deadline;
+  double interval;
+  size_t touches;
+} Bench_reloader;
+
+void *bench_reloader(void *arg)
+{
+  Bench_reloader *reloader = (Bench_reloader *)arg;
+  struct timespec delay = {.tv_sec = (time_t)reloader->interval,
+                           .tv_nsec = (long)((reloader->interval - (time_t)reloader->interval) * 1e9)};
+  struct timespec times[2] = {{.tv_nsec = UTIME_NOW}, {.tv_nsec = UTIME_NOW}};
+
+  while (now_seconds() < reloader->deadline) {
+    nanosleep(&delay, NULL);
+    if (utimensat(AT_FDCWD, reloader->document, times, 0) != 0) {
+      perror("utimensat");
+      break;
+    }
+    reloader->touches++;
+  }
+  return NULL;
+}
+
+int compare_latency(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+  Bench_client clients[DAEMON_BENCH_MAX_CLIENTS];
+  pthread_t threads[DAEMON_BENCH_MAX_CLIENTS];
+  int count = 4;
+  double seconds = 5;
+  double reload_ms = 0;
+
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s <socket> <document> <path> [--clients <n>] [--seconds <s>] [--reload <ms>]\n",
+            argv[0]);
+    return 2;
+  }
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+      count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = strtod(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--reload") == 0 && i + 1 < argc) {
+      reload_ms = strtod(argv[++i], NULL);
+    } else {
+      fprintf(stderr, "ERROR! Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (count < 1 || count > DAEMON_BENCH_MAX_CLIENTS || seconds <= 0 || reload_ms < 0) {
+    fprintf(stderr, "ERROR! Expected 1 to %d clients, a positive duration and reload interval\n",
+            DAEMON_BENCH_MAX_CLIENTS);
+    return 2;
+  }
+
+  // The first query loads the document, keep it out of the numbers
+  Json_client warmup;
+  Vector out;
+  vector_new(&out, 1, 4096);
+  if (!json_client_connect(&warmup, argv[1])) {
+    return 1;
+  }
+  json_client_query(&warmup, argv[2], argv[3], &out);
+  json_client_close(&warmup);
+  printf("result: %.*s\n", (int)(out.size > 200 ? 200 : out.size), (char *)out.items);
+  vector_deallocate(&out);
+
+  double start = now_seconds();
+  Bench_reloader reloader = {.document = argv[2], .deadline = start + seconds, .interval = reload_ms / 1e3};
+  pthread_t reload_thread;
+  int reloading = reload_ms > 0 && pthread_create(&reload_thread, NULL, bench_reloader, &reloader) == 0;
+  for (int i = 0; i < count; i++) {
+    clients[i] = (Bench_client){.socket_path = argv[1], .document = argv[2], .path = argv[3],
+                                .deadline = start + seconds};
+    vector_new(&clients[i].latencies, sizeof(uint64_t), 1 << 16);
+    if (pthread_create(&threads[i], NULL, bench_client, &clients[i]) != 0) {
+      fprintf(stderr, "ERROR! Couldn't start client thread\n");
+      return 1;
+    }
+  }
+
+  Vector latencies;
+  size_t errors = 0;
+  vector_new(&latencies, sizeof(uint64_t), 1 << 16);
+  for (int i = 0; i < count; i++) {
+    pthread_join(threads[i], NULL);
+    vector_append(&latencies, clients[i].latencies.items, clients[i].latencies.size);
+    errors += clients[i].errors;
+    vector_deallocate(&clients[i].latencies);
+  }
+  double elapsed = now_seconds() - start;
+  if (reloading) {
+    pthread_join(reload_thread, NULL);
+  }
+
+  if (latencies.size == 0) {
+    fprintf(stderr, "ERROR! No query completed\n");
+    return 1;
+  }
+  uint64_t *sorted = (uint64_t *)latencies.items;
+  qsort(sorted, latencies.size, sizeof(uint64_t), compare_latency);
+  printf("clients:  %d\n", count);
+  printf("queries:  %zu (%zu errors)\n", latencies.size, errors);
+  printf("qps:      %.0f\n", latencies.size / elapsed);
+  printf("p50:      %.1f us\n", sorted[latencies.size / 2] / 1e3);
+  printf("p99:      %.1f us\n", sorted[(size_t)(latencies.size * 0.99)] / 1e3);
+  printf("max:      %.1f us\n", sorted[latencies.size - 1] / 1e3);
+  if (reloading) {
+    printf("touches:  %zu\n", reloader.touches);
+  }
+  vector_deallocate(&latencies);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+volatile sig_atomic_t daemon_stop = 0;
+
+void daemon_interrupt(int signal)
+{
+  (void)signal;
+  daemon_stop = 1;
+}
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s <socket> [--workers <n>] <document>...\n"
+          "\n"
+          "Serves queries on the given documents, kept parsed in memory until\n"
+          "interrupted. Requests for any other path are refused. Documents are\n"
+          "reloaded when their file changes. See daemon.h for the protocol, or\n"
+          "use the json_client_* functions.\n"
+          "\n"
+          "options:\n"
+          "  --workers <n>   query threads (default: one per CPU)\n",
+          program);
+}
+
+int main(int argc, char **argv)
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t workers = cpus > 0 ? (size_t)cpus : 1;
+  const char *socket_path = NULL;
+  const char **documents = (const char **)malloc(argc * sizeof(char *));
+  size_t document_count = 0;
+
+  if (!documents) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for documents\n");
+    return 1;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      int n = atoi(argv[++i]);
+      if (n < 1) {
+        fprintf(stderr, "ERROR! --workers must be at least 1\n");
+        return 2;
+      }
+      workers = (size_t)n;
+    } else if (argv[i][0] != '-' && !socket_path) {
+      socket_path = argv[i];
+    } else if (argv[i][0] != '-') {
+      documents[document_count++] = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!socket_path || document_count == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  struct sigaction action = {0};
+  action.sa_handler = daemon_interrupt;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  Json_daemon daemon;
+  if (!json_daemon_start(&daemon, socket_path, workers, documents, document_count)) {
+    free(documents);
+    return 1;
+  }
+  int ok = json_daemon_run(&daemon, &daemon_stop);
+  json_daemon_stop(&daemon);
+  free(documents);
+  return ok ? 0 : 1;
+}
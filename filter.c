@@ -0,0 +1,284 @@
+#include "filter.h"
+#include "validate.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Records are first checked for the raw bytes every predicate needs ("key"
+// and, for string equality, "value"), so most non-matching records are
+// rejected by a vectorized substring search. Survivors are scanned in place
+// at the top level only, comparing referenced values and skipping the rest
+// without building nodes. Nothing is allocated per record.
+
+void json_filter_new(Json_filter *filter)
+{
+  filter->count = 0;
+}
+
+int json_filter_quote(const char *text, char **needle, size_t *needle_length)
+{
+  size_t length = strlen(text);
+  *needle = (char *)malloc(length + 3);
+  if (!*needle) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for filter\n");
+    return 0;
+  }
+  (*needle)[0] = '"';
+  memcpy(*needle + 1, text, length);
+  (*needle)[length + 1] = '"';
+  (*needle)[length + 2] = '\0';
+  *needle_length = length + 2;
+  return 1;
+}
+
+Json_predicate *json_filter_add(Json_filter *filter, JSON_PREDICATE_TYPE type, const char *key)
+{
+  if (filter->count == JSON_FILTER_MAX_PREDICATES) {
+    fprintf(stderr, "ERROR! A filter holds at most %d predicates\n", JSON_FILTER_MAX_PREDICATES);
+    return NULL;
+  }
+
+  Json_predicate *predicate = &filter->predicates[filter->count];
+  memset(predicate, 0, sizeof(*predicate));
+  predicate->type = type;
+  if (!json_filter_quote(key, &predicate->key_needle, &predicate->key_needle_length)) {
+    return NULL;
+  }
+  filter->count++;
+  return predicate;
+}
+
+int json_filter_add_exists(Json_filter *filter, const char *key)
+{
+  return json_filter_add(filter, JSON_PREDICATE_EXISTS, key) != NULL;
+}
+
+int json_filter_add_equals_string(Json_filter *filter, const char *key, const char *value)
+{
+  Json_predicate *predicate = json_filter_add(filter, JSON_PREDICATE_EQUALS_STRING, key);
+  return predicate && json_filter_quote(value, &predicate->value_needle, &predicate->value_needle_length);
+}
+
+int json_filter_add_equals_number(Json_filter *filter, const char *key, double value)
+{
+  Json_predicate *predicate = json_filter_add(filter, JSON_PREDICATE_EQUALS_NUMBER, key);
+  if (!predicate) {
+    return 0;
+  }
+  predicate->min = value;
+  predicate->max = value;
+  return 1;
+}
+
+int json_filter_add_range(Json_filter *filter, const char *key, double min, double max)
+{
+  Json_predicate *predicate = json_filter_add(filter, JSON_PREDICATE_RANGE, key);
+  if (!predicate) {
+    return 0;
+  }
+  predicate->min = min;
+  predicate->max = max;
+  return 1;
+}
+
+void json_filter_deallocate(Json_filter *filter)
+{
+  for (size_t i = 0; i < filter->count; i++) {
+    free(filter->predicates[i].key_needle);
+    free(filter->predicates[i].value_needle);
+  }
+  filter->count = 0;
+}
+
+const char *json_memmem(const char *haystack, size_t length, const char *needle, size_t needle_length)
+{
+  size_t i = 0;
+
+  if (needle_length == 0) {
+    return haystack;
+  }
+  if (needle_length > length) {
+    return NULL;
+  }
+  if (needle_length == 1) {
+    return memchr(haystack, needle[0], length);
+  }
+
+#ifdef __SSE2__
+  // Compare the first and last needle bytes against 16 positions at once
+  // and only memcmp where both match
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+  for (; i + needle_length - 1 + 16 <= length; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(haystack + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(haystack + i + needle_length - 1));
+    int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      size_t candidate = i + __builtin_ctz(mask);
+      if (memcmp(haystack + candidate + 1, needle + 1, needle_length - 2) == 0) {
+        return haystack + candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; i + needle_length <= length; i++) {
+    if (haystack[i] == needle[0] && memcmp(haystack + i + 1, needle + 1, needle_length - 1) == 0) {
+      return haystack + i;
+    }
+  }
+  return NULL;
+}
+
+int json_filter_number(const char *s, size_t length, double *value)
+{
+  char buffer[64];
+  char *end;
+
+  if (length == 0 || length >= sizeof(buffer) || (s[0] != '-' && (s[0] < '0' || s[0] > '9'))) {
+    return 0;
+  }
+  memcpy(buffer, s, length);
+  buffer[length] = '\0';
+  *value = strtod(buffer, &end);
+  return end == buffer + length;
+}
+
+int json_filter_test(const Json_predicate *predicate, const char *value, size_t length)
+{
+  double number;
+
+  switch (predicate->type) {
+    case JSON_PREDICATE_EXISTS:
+      return 1;
+    case JSON_PREDICATE_EQUALS_STRING:
+      return length == predicate->value_needle_length &&
+             memcmp(value, predicate->value_needle, length) == 0;
+    case JSON_PREDICATE_EQUALS_NUMBER:
+    case JSON_PREDICATE_RANGE:
+      return json_filter_number(value, length, &number) &&
+             number >= predicate->min && number <= predicate->max;
+  }
+  return 0;
+}
+
+int json_filter_match(const Json_filter *filter, const char *record, size_t length)
+{
+  unsigned int satisfied = 0;
+  unsigned int all = (1u << filter->count) - 1;
+
+  for (size_t i = 0; i < filter->count; i++) {
+    const Json_predicate *predicate = &filter->predicates[i];
+    if (!json_memmem(record, length, predicate->key_needle, predicate->key_needle_length) ||
+        (predicate->value_needle &&
+         !json_memmem(record, length, predicate->value_needle, predicate->value_needle_length))) {
+      return 0;
+    }
+  }
+
+  size_t pos = 0;
+  while (pos < length && json_is_space(record[pos])) {
+    pos++;
+  }
+  if (pos >= length || record[pos] != '{') {
+    return 0;
+  }
+  pos++;
+
+  for (;;) {
+    while (pos < length && json_is_space(record[pos])) {
+      pos++;
+    }
+    if (pos < length && record[pos] == '}') {
+      break;
+    }
+    if (pos >= length || record[pos] != '"') {
+      return 0;
+    }
+
+    size_t key = pos;
+    if (!json_skip_value(record, length, &pos)) {
+      return 0;
+    }
+    size_t key_length = pos - key;
+
+    while (pos < length && json_is_space(record[pos])) {
+      pos++;
+    }
+    if (pos >= length || record[pos] != ':') {
+      return 0;
+    }
+    pos++;
+    while (pos < length && json_is_space(record[pos])) {
+      pos++;
+    }
+
+    size_t value = pos;
+    if (!json_skip_value(record, length, &pos)) {
+      return 0;
+    }
+
+    for (size_t i = 0; i < filter->count; i++) {
+      const Json_predicate *predicate = &filter->predicates[i];
+      if (key_length == predicate->key_needle_length &&
+          memcmp(record + key, predicate->key_needle, key_length) == 0 &&
+          json_filter_test(predicate, record + value, pos - value)) {
+        satisfied |= 1u << i;
+      }
+    }
+    if (satisfied == all) {
+      return 1;
+    }
+
+    while (pos < length && json_is_space(record[pos])) {
+      pos++;
+    }
+    if (pos < length && record[pos] == ',') {
+      pos++;
+    } else if (pos >= length || record[pos] != '}') {
+      return 0;
+    }
+  }
+
+  return satisfied == all;
+}
+
+// Runs the filter over every line of an NDJSON buffer, returns the number
+// of matches. Lines are passed without their '\r\n' and numbered from 1;
+// blank lines aren't records and are skipped. When lines isn't NULL it's
+// set to the number of lines in buf.
+size_t json_filter_scan(const Json_filter *filter, const char *buf, size_t length,
+                        Json_filter_callback callback, void *user_data, size_t *lines)
+{
+  const char *p = buf;
+  const char *end = buf + length;
+  size_t matches = 0;
+  size_t line_number = 0;
+
+  while (p < end) {
+    const char *newline = memchr(p, '\n', end - p);
+    size_t line = (newline ? newline : end) - p;
+    line_number++;
+    if (line > 0 && p[line - 1] == '\r') {
+      line--;
+    }
+
+    size_t blank = 0;
+    while (blank < line && json_is_space(p[blank])) {
+      blank++;
+    }
+    if (blank < line && json_filter_match(filter, p, line)) {
+      matches++;
+      if (callback) {
+        callback(p, line, line_number, user_data);
+      }
+    }
+    p = newline ? newline + 1 : end;
+  }
+  if (lines) {
+    *lines = line_number;
+  }
+  return matches;
+}
@@ -0,0 +1,48 @@
+#ifndef __FILTER__
+#define __FILTER__
+
+#include "uds.h"
+
+#define JSON_FILTER_MAX_PREDICATES 16
+
+typedef enum {
+  JSON_PREDICATE_EXISTS,
+  JSON_PREDICATE_EQUALS_STRING,
+  JSON_PREDICATE_EQUALS_NUMBER,
+  JSON_PREDICATE_RANGE
+} JSON_PREDICATE_TYPE;
+
+// Predicates test top-level keys of object records. Strings are compared
+// as written in the record, escapes included.
+typedef struct Json_predicate {
+  JSON_PREDICATE_TYPE type;
+  char *key_needle;   // "key", quotes included
+  size_t key_needle_length;
+  char *value_needle; // "value" for EQUALS_STRING, NULL otherwise
+  size_t value_needle_length;
+  double min;
+  double max;
+} Json_predicate;
+
+// All predicates must hold for a record to match
+typedef struct Json_filter {
+  Json_predicate predicates[JSON_FILTER_MAX_PREDICATES];
+  size_t count;
+} Json_filter;
+
+// line is 1-based, counted from the start of the scanned buffer
+typedef void (*Json_filter_callback)(const char *record, size_t length, size_t line, void *user_data);
+
+void json_filter_new(Json_filter *filter);
+int json_filter_add_exists(Json_filter *filter, const char *key);
+int json_filter_add_equals_string(Json_filter *filter, const char *key, const char *value);
+int json_filter_add_equals_number(Json_filter *filter, const char *key, double value);
+int json_filter_add_range(Json_filter *filter, const char *key, double min, double max);
+void json_filter_deallocate(Json_filter *filter);
+
+int json_filter_match(const Json_filter *filter, const char *record, size_t length);
+size_t json_filter_scan(const Json_filter *filter, const char *buf, size_t length,
+                        Json_filter_callback callback, void *user_data, size_t *lines);
+const char *json_memmem(const char *haystack, size_t length, const char *needle, size_t needle_length);
+
+#endif // __FILTER__
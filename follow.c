@@ -0,0 +1,339 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "follow.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Each poll reads what was appended since the last one into a buffer that
+// still starts with the held partial line, validates and parses the
+// complete lines with the same parser and keeps the new tail. The
+// checkpoint is the offset of the first unconsumed byte and the number of
+// lines before it, written to a temporary file and renamed over the old
+// one so a crash never leaves a torn checkpoint behind.
+
+void follow_watch(Json_follower *follower)
+{
+#ifdef __linux__
+  if (follower->inotify_fd < 0) {
+    return;
+  }
+  if (follower->watch >= 0) {
+    inotify_rm_watch(follower->inotify_fd, follower->watch);
+  }
+  follower->watch = inotify_add_watch(follower->inotify_fd, follower->path,
+                                      IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+  if (follower->watch < 0) {
+    close(follower->inotify_fd); // Fall back to polling
+    follower->inotify_fd = -1;
+  }
+#else
+  (void)follower;
+#endif
+}
+
+int follow_open_file(Json_follower *follower)
+{
+  int fd = open(follower->path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR! can't open file %s\n", follower->path);
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    fprintf(stderr, "ERROR! %s isn't a regular file\n", follower->path);
+    close(fd);
+    return 0;
+  }
+  if (follower->fd >= 0) {
+    close(follower->fd);
+  }
+  follower->fd = fd;
+  follower->device = st.st_dev;
+  follower->inode = st.st_ino;
+  follower->offset = 0;
+  follower->lines = 0;
+  follower->buffer.size = 0;
+  follow_watch(follower);
+  return 1;
+}
+
+// Resumes from the checkpoint when it was taken on the same file and the
+// file hasn't shrunk below it since
+void follow_load_checkpoint(Json_follower *follower)
+{
+  FILE *f = fopen(follower->checkpoint_path, "r");
+  if (!f) {
+    return;
+  }
+  unsigned long long offset, device, inode, lines = 0;
+  int fields = fscanf(f, "%llu %llu %llu %llu", &offset, &device, &inode, &lines);
+  fclose(f);
+
+  struct stat st;
+  if (fields < 3 || fstat(follower->fd, &st) != 0) {
+    fprintf(stderr, "ERROR! Ignoring unreadable checkpoint %s\n", follower->checkpoint_path);
+    return;
+  }
+  if ((dev_t)device == follower->device && (ino_t)inode == follower->inode && offset <= (unsigned long long)st.st_size) {
+    follower->offset = (size_t)offset;
+    follower->lines = (size_t)lines; // Counted from the resume point by checkpoints without it
+    follower->checkpointed = (size_t)offset;
+  }
+}
+
+int json_follow_open(Json_follower *follower, const char *path, const char *checkpoint_path, unsigned int flags)
+{
+  memset(follower, 0, sizeof(*follower));
+  follower->fd = -1;
+  follower->inotify_fd = -1;
+  follower->watch = -1;
+  follower->parser.flags = flags;
+
+  if (!slice_to_owned(_slice((char *)path), &follower->path)) {
+    return 0;
+  }
+  if (checkpoint_path && !slice_to_owned(_slice((char *)checkpoint_path), &follower->checkpoint_path)) {
+    json_follow_close(follower);
+    return 0;
+  }
+  if (!vector_new(&follower->buffer, 1, JSON_FOLLOW_READ_CHUNK)) {
+    json_follow_close(follower);
+    return 0;
+  }
+#ifdef __linux__
+  follower->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  if (!follow_open_file(follower)) {
+    json_follow_close(follower);
+    return 0;
+  }
+  if (follower->checkpoint_path) {
+    follow_load_checkpoint(follower);
+  }
+  return 1;
+}
+
+// Validates and parses every complete line in the buffer and keeps the
+// trailing partial one. Invalid lines never reach the lenient parser.
+void follow_consume(Json_follower *follower, Json_follow_callback callback, void *user_data, size_t *records)
+{
+  char *data = (char *)follower->buffer.items;
+  size_t size = follower->buffer.size;
+  size_t start = 0;
+
+  for (;;) {
+    char *newline = memchr(data + start, '\n', size - start);
+    if (!newline) {
+      break;
+    }
+    size_t end = (size_t)(newline - data);
+    size_t length = end - start;
+    if (length > 0 && data[start + length - 1] == '\r') {
+      length--;
+    }
+    size_t blank = 0;
+    while (blank < length && json_is_space(data[start + blank])) {
+      blank++;
+    }
+    follower->lines++;
+    if (blank < length) {
+      Json_object object = {0};
+      Json_error error = {0};
+      if (!json_validate(data + start, length, &error)) {
+        callback(data + start, length, follower->lines, follower->offset + start, &object, &error, user_data);
+      } else if (!json_parse_buffer(&follower->parser, data + start, length, &object)) {
+        error.message = "Couldn't parse document";
+        error.line = 1;
+        error.column = 1;
+        callback(data + start, length, follower->lines, follower->offset + start, &object, &error, user_data);
+      } else {
+        callback(data + start, length, follower->lines, follower->offset + start, &object, NULL, user_data);
+      }
+      json_unload(&object);
+      (*records)++;
+    }
+    start = end + 1;
+  }
+
+  if (start > 0) {
+    memmove(data, data + start, size - start);
+    follower->buffer.size = size - start;
+    follower->offset += start;
+  }
+}
+
+// Reads and parses everything appended since the last call. Starts over
+// when the file was truncated below the consumed offset, and switches to
+// the new file once the old one is drained when the path was rotated.
+int json_follow_poll(Json_follower *follower, Json_follow_callback callback, void *user_data, size_t *records)
+{
+  size_t count = 0;
+  struct stat st;
+
+  for (;;) {
+    if (fstat(follower->fd, &st) != 0) {
+      perror("fstat");
+      return 0;
+    }
+    if ((size_t)st.st_size < follower->offset + follower->buffer.size) {
+      fprintf(stderr, "ERROR! %s was truncated, following from the start\n", follower->path);
+      follower->offset = 0;
+      follower->lines = 0;
+      follower->buffer.size = 0;
+    }
+
+    for (;;) {
+      if (!vector_reserve(&follower->buffer, follower->buffer.size + JSON_FOLLOW_READ_CHUNK)) {
+        return 0;
+      }
+      ssize_t n = pread(follower->fd, (char *)follower->buffer.items + follower->buffer.size,
+                        JSON_FOLLOW_READ_CHUNK, (off_t)(follower->offset + follower->buffer.size));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        perror("pread");
+        return 0;
+      }
+      if (n == 0) {
+        break;
+      }
+      follower->buffer.size += (size_t)n;
+      follow_consume(follower, callback, user_data, &count);
+    }
+
+    struct stat current;
+    if (stat(follower->path, &current) != 0 ||
+        (current.st_dev == follower->device && current.st_ino == follower->inode)) {
+      break;
+    }
+    if (follower->buffer.size > 0) {
+      fprintf(stderr, "ERROR! %s was rotated, dropping %zu bytes of an unterminated line\n",
+              follower->path, follower->buffer.size);
+    }
+    if (!follow_open_file(follower)) {
+      return 0;
+    }
+    follower->checkpointed = (size_t)-1; // The old offset belongs to the old file
+  }
+
+  if (records) {
+    *records = count;
+  }
+  return 1;
+}
+
+// Blocks until the file changes or timeout_ms elapses. Without inotify it
+// just sleeps, the next poll finds out whether anything was appended.
+int json_follow_wait(Json_follower *follower, int timeout_ms)
+{
+#ifdef __linux__
+  if (follower->inotify_fd >= 0) {
+    struct pollfd pfd = {.fd = follower->inotify_fd, .events = POLLIN};
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR) {
+      perror("poll");
+      return 0;
+    }
+    if (ready > 0) {
+      char events[4096];
+      while (read(follower->inotify_fd, events, sizeof(events)) > 0) {
+        // Drained, the events only mean "look again"
+      }
+    }
+    return 1;
+  }
+#endif
+  struct timespec delay = {.tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000};
+  if (nanosleep(&delay, NULL) != 0 && errno != EINTR) {
+    perror("nanosleep");
+    return 0;
+  }
+  return 1;
+}
+
+// Polls until *stop is set, flushing and checkpointing after every poll
+// that consumed something and checkpointing once more before returning.
+// flush may be NULL.
+int json_follow_run(Json_follower *follower, Json_follow_callback callback, Json_follow_flush_callback flush,
+                    void *user_data, volatile sig_atomic_t *stop)
+{
+  int ok = 1;
+
+  while (ok && !*stop) {
+    size_t records = 0;
+    ok = json_follow_poll(follower, callback, user_data, &records);
+    if (flush && records > 0) {
+      flush(user_data);
+    }
+    ok = ok && json_follow_checkpoint(follower);
+    if (ok && !*stop) {
+      ok = json_follow_wait(follower, JSON_FOLLOW_POLL_MS);
+    }
+  }
+  return json_follow_checkpoint(follower) && ok;
+}
+
+int json_follow_checkpoint(Json_follower *follower)
+{
+  if (!follower->checkpoint_path || follower->checkpointed == follower->offset) {
+    return 1;
+  }
+
+  size_t length = strlen(follower->checkpoint_path);
+  char *tmp_path = (char *)malloc(length + sizeof(".tmp"));
+  if (!tmp_path) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for checkpoint path\n");
+    return 0;
+  }
+  memcpy(tmp_path, follower->checkpoint_path, length);
+  memcpy(tmp_path + length, ".tmp", sizeof(".tmp"));
+
+  char line[128];
+  int line_length = snprintf(line, sizeof(line), "%llu %llu %llu %llu\n", (unsigned long long)follower->offset,
+                             (unsigned long long)follower->device, (unsigned long long)follower->inode,
+                             (unsigned long long)follower->lines);
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int ok = fd >= 0 && write(fd, line, (size_t)line_length) == line_length && fsync(fd) == 0;
+  if (fd >= 0) {
+    ok &= close(fd) == 0;
+  }
+  ok = ok && rename(tmp_path, follower->checkpoint_path) == 0;
+  if (!ok) {
+    fprintf(stderr, "ERROR! Couldn't write checkpoint %s\n", follower->checkpoint_path);
+    unlink(tmp_path);
+  } else {
+    follower->checkpointed = follower->offset;
+  }
+  free(tmp_path);
+  return ok;
+}
+
+void json_follow_close(Json_follower *follower)
+{
+  if (follower->fd >= 0) {
+    close(follower->fd);
+  }
+#ifdef __linux__
+  if (follower->inotify_fd >= 0) {
+    close(follower->inotify_fd);
+  }
+#endif
+  free(follower->path);
+  free(follower->checkpoint_path);
+  vector_deallocate(&follower->buffer);
+  memset(follower, 0, sizeof(*follower));
+  follower->fd = -1;
+  follower->inotify_fd = -1;
+  follower->watch = -1;
+}
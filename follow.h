@@ -0,0 +1,50 @@
+#ifndef __FOLLOW__
+#define __FOLLOW__
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include "json.h"
+#include "validate.h"
+
+#define JSON_FOLLOW_READ_CHUNK (1 << 16)
+#define JSON_FOLLOW_POLL_MS 250 // Polling interval, and the inotify wait timeout
+
+// Called once per complete appended line that isn't blank, in file order.
+// line_number is 1-based and offset is the byte offset of the line in the
+// file. Lines are validated before they are parsed: error is NULL for
+// valid ones, otherwise it says why and obj is left empty. The document is
+// unloaded once the callback returns.
+typedef void (*Json_follow_callback)(const char *line, size_t length, size_t line_number, size_t offset,
+                                     Json_object *obj, const Json_error *error, void *user_data);
+
+// Called by json_follow_run after every poll that found lines, so output
+// batched by the line callback can be flushed
+typedef void (*Json_follow_flush_callback)(void *user_data);
+
+// Tails a growing NDJSON file. Bytes after the last newline are held until
+// the line is complete, so offset always sits at the start of a line.
+typedef struct Json_follower {
+  char *path;
+  char *checkpoint_path; // NULL when no checkpoint is kept
+  int fd;
+  dev_t device;
+  ino_t inode;
+  size_t offset;         // File offset of the first byte not consumed yet
+  size_t lines;          // Lines consumed before offset
+  size_t checkpointed;   // Offset saved by the last checkpoint
+  Vector buffer;         // char, held partial line followed by newly read bytes
+  json_parser parser;    // Reused for every line
+  int inotify_fd;        // -1 when polling
+  int watch;
+} Json_follower;
+
+int json_follow_open(Json_follower *follower, const char *path, const char *checkpoint_path, unsigned int flags);
+int json_follow_poll(Json_follower *follower, Json_follow_callback callback, void *user_data, size_t *records);
+int json_follow_wait(Json_follower *follower, int timeout_ms);
+int json_follow_run(Json_follower *follower, Json_follow_callback callback, Json_follow_flush_callback flush,
+                    void *user_data, volatile sig_atomic_t *stop);
+int json_follow_checkpoint(Json_follower *follower);
+void json_follow_close(Json_follower *follower);
+
+#endif // __FOLLOW__
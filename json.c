@@ -0,0 +1,1279 @@
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+
+#include "json.h"
+
+#define COLOR_RESET   "\x1b[0m"
+#define COLOR_YELLOW  "\x1b[33m"
+#define COLOR_BLUE    "\x1b[34m"
+#define COLOR_RED     "\x1b[31m"
+#define COLOR_GREEN   "\x1b[32m"
+
+void advance(json_lexer *lexer)
+{
+  // Copies made by peek_token share the source, so always pick up its
+  // latest buffer
+  if (lexer->source) {
+    while (lexer->read_pos >= lexer->source->length && lexer->source->refill(lexer->source)) {
+    }
+    lexer->content = lexer->source->data;
+    lexer->length = lexer->source->length;
+  }
+  if (lexer->read_pos >= lexer->length) {
+    lexer->ch = EOF;
+  } else {
+    lexer->ch = lexer->content[lexer->read_pos];
+  }
+  lexer->pos = lexer->read_pos;
+  lexer->read_pos++;
+}
+
+void init_lexer(json_lexer *lexer, size_t length)
+{
+  lexer->source = NULL;
+  lexer->length = length;
+  lexer->pos = 0;
+  lexer->read_pos= 0;
+  advance(lexer);
+}
+
+int json_load_file(json_lexer *lexer, const char *file_path)
+{
+  FILE *f = fopen(file_path, "rb");
+  if (!f) {
+    fprintf(stderr, "ERROR! can't open file %s\n", file_path);
+    return 0;
+  }
+  fseek(f, 0, SEEK_END);
+  size_t content_len = ftell(f);
+  rewind(f);
+
+  lexer->content = (char *)malloc(content_len + 1);
+  if (!lexer->content) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for file %s\n", file_path);
+    fclose(f);
+    return 0;
+  }
+
+  size_t bytes_read = fread(lexer->content, 1, content_len, f);
+  lexer->content[bytes_read] = '\0';
+  fclose(f);
+
+  init_lexer(lexer, bytes_read);
+  return 1;
+}
+
+void skip_white_space(json_lexer *lexer)
+{
+    while (isspace(lexer->ch))
+    {
+        advance(lexer);
+    }
+}
+
+Slice read_string(json_lexer *lexer)
+{
+  size_t start = lexer->pos + 1;
+  advance(lexer);
+  while (lexer->ch != '"' && lexer->ch != '\0' && lexer->ch != EOF)
+  {
+      if (lexer->ch == '\\') {
+          advance(lexer); // Skip the escaped character
+      }
+      advance(lexer);
+  }
+
+  size_t len = lexer->pos - start;
+  advance(lexer); // Past the closing quote, before slicing: a source may move content here
+  Slice str = {
+      .data = lexer->content + start,
+      .length = len};
+  return str;
+}
+
+Slice read_number(json_lexer *lexer)
+{
+  size_t start = lexer->pos;
+  while (isdigit(lexer->ch) || lexer->ch == '.' || lexer->ch == '-' ||
+         lexer->ch == '+' || lexer->ch == 'e' || lexer->ch == 'E') {
+      advance(lexer);
+  }
+
+  size_t len = lexer->pos - start;
+  Slice number = {
+      .data = lexer->content + start,
+      .length = len
+  };
+  return number;
+}
+
+Slice read_keyword(json_lexer *lexer)
+{
+  size_t start = lexer->pos;
+  while (isalpha(lexer->ch))
+  {
+      advance(lexer);
+  }
+
+  size_t len = lexer->pos - start;
+  Slice keyword = {
+      .data = lexer->content + start,
+      .length = len};
+  return keyword;
+}
+
+Json_token next_token(json_lexer *lexer)
+{
+  Json_token token;
+  skip_white_space(lexer);
+
+  switch (lexer->ch)
+  {
+    case '{':
+      token.type = JSON_TOKEN_CURLY_LBRACE;
+      token.literal = _slice("{");
+      advance(lexer);
+      break;
+    case '}':
+      token.type = JSON_TOKEN_CURLY_RBRACE;
+      token.literal = _slice("}");
+      advance(lexer);
+      break;
+    case '[':
+      token.type = JSON_TOKEN_SQUARE_LBRACE;
+      token.literal = _slice("[");
+      advance(lexer);
+      break;
+    case ']':
+      token.type = JSON_TOKEN_SQUARE_RBRACE;
+      token.literal = _slice("]");
+      advance(lexer);
+      break;
+    case ',':
+      token.type = JSON_TOKEN_COMMA;
+      token.literal = _slice(",");
+      advance(lexer);
+      break;
+    case ':':
+      token.type = JSON_TOKEN_COLON;
+      token.literal = _slice(":");
+      advance(lexer);
+      break;
+    case '"':
+      token.type = JSON_TOKEN_STRING;
+      token.literal = read_string(lexer);
+      break;
+    case EOF:
+      token.type = JSON_TOKEN_EOF;
+      token.literal = _slice("EOF");
+      advance(lexer);
+      break;
+    case '\n':
+    case '\r':
+    case '\t':
+      advance(lexer);
+      break;
+    default:
+      if (isdigit(lexer->ch) || lexer->ch == '-') {
+          token.type = JSON_TOKEN_NUMBER;
+          token.literal = read_number(lexer);
+      } else if (isalpha(lexer->ch)) {
+          token.literal = read_keyword(lexer);
+          if (slice_equals(token.literal, _slice("true")) || slice_equals(token.literal, _slice("false")))
+          {
+              token.type = JSON_TOKEN_BOOLEAN;
+          }
+          else if (slice_equals(token.literal, _slice("null")))
+          {
+              token.type = JSON_TOKEN_NULL;
+          }
+          else
+          {
+              token.type = JSON_TOKEN_INVALID;
+          }
+      }
+      else
+      {
+          token.type = JSON_TOKEN_INVALID;
+          token.literal = slice_null;
+      }
+    }
+  return token;
+}
+
+
+char *json_token_type_to_string(JSON_TOKEN_TYPE type)
+{
+    switch (type)
+    {
+    case JSON_TOKEN_BOOLEAN:
+        return "BOOLEAN";
+    case JSON_TOKEN_COLON:
+        return "COLON";
+    case JSON_TOKEN_COMMA:
+        return "COMMA";
+    case JSON_TOKEN_CURLY_LBRACE:
+        return "CURLY_LBRACE";
+    case JSON_TOKEN_CURLY_RBRACE:
+        return "CURLY_RBRACE";
+    case JSON_TOKEN_EOF:
+        return "EOF";
+    case JSON_TOKEN_INVALID:
+        return "INVALID";
+    case JSON_TOKEN_NULL:
+        return "NULL";
+    case JSON_TOKEN_NUMBER:
+        return "NUMBER";
+    case JSON_TOKEN_SQUARE_LBRACE:
+        return "SQUARE_LBRACE";
+    case JSON_TOKEN_SQUARE_RBRACE:
+        return "SQUARE_RBRACE";
+    case JSON_TOKEN_STRING:
+        return "STRING";
+    default:
+      return NULL;
+    }
+}
+
+void print_token(Json_token *token)
+{
+    char *type = json_token_type_to_string(token->type);
+    //printf(COLOR_RED"############# DEBUG TOKEN INFO #############"COLOR_RESET"\n");
+    //printf(COLOR_YELLOW "type: %s" COLOR_RESET " value: " COLOR_BLUE slice_fmt COLOR_RESET "\n", 
+    //       type, slice_args(token->literal));
+    //printf(COLOR_RED"############################################"COLOR_RESET"\n\n");
+    printf("############# DEBUG TOKEN INFO #############""\n");
+    printf("type: %s"" value: "slice_fmt"\n", 
+           type, slice_args(token->literal));
+    printf("############################################""\n\n");
+}
+
+Json_token peek_token(json_lexer *lexer)
+{
+    json_lexer temp = *lexer;
+    return next_token(&temp);
+}
+
+int parse(json_parser *parser, Json_node *node);
+int json_slice_to_int64(Slice number, int64_t *value);
+double json_slice_to_double(Slice number);
+
+
+int parse_object(json_parser *parser, Json_node *node)
+{
+  Json_node_map_new(&node->map);
+  node->type = JSON_NODE_OBJECT;
+
+  while (peek_token(&parser->lexer).type != JSON_TOKEN_CURLY_RBRACE) {
+    Json_token key = next_token(&parser->lexer);
+    char *key_str;
+
+    if (key.type != JSON_TOKEN_STRING) {
+      printf("ERROR! Expected token string got %s\n", json_token_type_to_string(key.type));
+      return 0;
+    }
+
+    if (!slice_to_owned(key.literal, &key_str)) {
+      printf("ERROR! Couldn't allocate memory for key string\n");
+      return 0;
+    }
+
+    Json_token expected = next_token(&parser->lexer);
+    if (expected.type != JSON_TOKEN_COLON) {
+      printf("ERROR! Expected token \":\" got %s\n", json_token_type_to_string(expected.type));
+      free(key_str);
+      return 0;
+    }
+
+    // A value that fails keeps what it built, it isn't in the map yet
+    Json_node value = {0};
+    if (!parse(parser, &value)) {
+      printf("ERROR! Couldn't parse object\n");
+      free(key_str);
+      json_free(&value);
+      return 0;
+    }
+    value.offset -= node->offset;
+
+    int created;
+    Json_node *slot = Json_node_map_emplace(&node->map, key_str, &created);
+    if (!slot) {
+      free(key_str);
+      json_free(&value);
+      return 0;
+    }
+    if (!created) {
+      // Duplicate key, the last value wins
+      free(key_str);
+      json_free(slot);
+    }
+    *slot = value;
+
+    Json_token peek = peek_token(&parser->lexer);
+    if (peek.type == JSON_TOKEN_CURLY_RBRACE) {
+      break;
+    } else if (peek.type == JSON_TOKEN_COMMA) {
+      next_token(&parser->lexer); // Consume ","
+    } else {
+      printf("ERROR! Expected token \",\" (COMMA) or \"}\" (CURLY_RBRACE), but got %s\n", json_token_type_to_string(peek.type));
+      print_token(&peek);
+      return 0;
+    }
+  }
+
+  next_token(&parser->lexer); // Consume "}"
+  return 1;
+}
+
+#define JSON_PACK_MISMATCH -1
+
+// Packs an array whose first element is a number or a boolean. Integers are
+// kept as int64_t until the first non-integer, which turns every element
+// into a double in place. Returns JSON_PACK_MISMATCH, with nothing consumed
+// from the caller's point of view, when an element doesn't fit the type.
+int parse_packed_array(json_parser *parser, Json_node *node)
+{
+  json_lexer start = parser->lexer;
+  int booleans = peek_token(&parser->lexer).type == JSON_TOKEN_BOOLEAN;
+  size_t capacity = booleans ? 64 : 8;
+  size_t element_size = booleans ? sizeof(uint64_t) : sizeof(double);
+
+  node->packed.items = calloc(booleans ? capacity / 64 : capacity, element_size);
+  if (!node->packed.items) {
+    printf("ERROR! Couldn't allocate memory for packed array\n");
+    return 0;
+  }
+  node->packed.size = 0;
+  node->packed.type = booleans ? JSON_PACKED_BOOLEAN : JSON_PACKED_INT64;
+  node->flags |= JSON_NODE_FLAG_PACKED;
+
+  for (;;) {
+    Json_token token = next_token(&parser->lexer);
+    size_t i = node->packed.size;
+
+    if (token.type != (booleans ? JSON_TOKEN_BOOLEAN : JSON_TOKEN_NUMBER)) {
+      free(node->packed.items);
+      node->flags &= ~JSON_NODE_FLAG_PACKED;
+      parser->lexer = start;
+      return JSON_PACK_MISMATCH;
+    }
+    if (i == capacity) {
+      size_t words = booleans ? capacity / 64 : capacity;
+      void *items = realloc(node->packed.items, words * 2 * element_size);
+      if (!items) {
+        printf("ERROR! Couldn't allocate memory for packed array\n");
+        return 0;
+      }
+      memset((char *)items + words * element_size, 0, words * element_size);
+      node->packed.items = items;
+      capacity *= 2;
+    }
+
+    if (booleans) {
+      if (slice_equals(token.literal, _slice("true"))) {
+        ((uint64_t *)node->packed.items)[i / 64] |= (uint64_t)1 << (i % 64);
+      }
+    } else {
+      int64_t integer;
+      if (node->packed.type == JSON_PACKED_INT64 && !json_slice_to_int64(token.literal, &integer)) {
+        int64_t *ints = (int64_t *)node->packed.items;
+        double *doubles = (double *)node->packed.items;
+        for (size_t j = 0; j < i; j++) {
+          doubles[j] = (double)ints[j];
+        }
+        node->packed.type = JSON_PACKED_DOUBLE;
+      }
+      if (node->packed.type == JSON_PACKED_INT64) {
+        ((int64_t *)node->packed.items)[i] = integer;
+      } else {
+        ((double *)node->packed.items)[i] = json_slice_to_double(token.literal);
+      }
+    }
+    node->packed.size++;
+
+    Json_token peek = peek_token(&parser->lexer);
+    if (peek.type == JSON_TOKEN_SQUARE_RBRACE) {
+      break;
+    } else if (peek.type == JSON_TOKEN_COMMA) {
+      next_token(&parser->lexer); // Consume ","
+    } else {
+      printf("ERROR! Expected token \",\" or \"]\" but got %s\n", json_token_type_to_string(peek.type));
+      print_token(&peek);
+      return 0;
+    }
+  }
+
+  // Give back the growth slack, packed arrays are usually the large ones
+  size_t words = booleans ? (node->packed.size + 63) / 64 : node->packed.size;
+  void *items = realloc(node->packed.items, words * element_size);
+  if (items) {
+    node->packed.items = items;
+  }
+  next_token(&parser->lexer); // Consume "]"
+  return 1;
+}
+
+int parse_array(json_parser *parser, Json_node *node)
+{
+  node->type = JSON_NODE_ARRAY;
+  if (parser->flags & JSON_PARSE_PACK_ARRAYS) {
+    // Lazy numbers need their text, so only booleans are packed with them
+    JSON_TOKEN_TYPE first = peek_token(&parser->lexer).type;
+    if (first == JSON_TOKEN_BOOLEAN || (first == JSON_TOKEN_NUMBER && !(parser->flags & JSON_PARSE_LAZY_NUMBERS))) {
+      int packed = parse_packed_array(parser, node);
+      if (packed != JSON_PACK_MISMATCH) {
+        return packed;
+      }
+    }
+  }
+
+  if (!Json_node_vector_new(&node->array, 1)) {
+    return 0;
+  }
+
+  while (peek_token(&parser->lexer).type != JSON_TOKEN_SQUARE_RBRACE)
+  {
+    Json_node value = {0};
+    if (!parse(parser, &value)) {
+      printf("ERROR! Couldn't parse\n");
+      json_free(&value);
+      return 0;
+    }
+    value.offset -= node->offset;
+
+    if (!Json_node_vector_push_back(&node->array, &value)) {
+      json_free(&value);
+      return 0;
+    }
+    Json_token peek = peek_token(&parser->lexer);
+    if (peek.type == JSON_TOKEN_SQUARE_RBRACE) {
+      break;
+    } else if (peek.type == JSON_TOKEN_COMMA) {
+      next_token(&parser->lexer); // Consume ","
+    } else {
+      printf("ERROR! Expected token \",\" or \"]\" but got %s\n", json_token_type_to_string(peek.type));
+      print_token(&peek);
+      return 0;
+    }
+  }
+
+  next_token(&parser->lexer); // Consume "]"
+  return 1;
+}
+
+// Fails when the text isn't an integer or doesn't fit in int64_t
+int json_slice_to_int64(Slice number, int64_t *value)
+{
+  char buffer[32];
+  if (number.length >= sizeof(buffer) || memchr(number.data, '.', number.length) ||
+      memchr(number.data, 'e', number.length) || memchr(number.data, 'E', number.length)) {
+    return 0;
+  }
+  memcpy(buffer, number.data, number.length);
+  buffer[number.length] = '\0';
+  errno = 0;
+  long long parsed = strtoll(buffer, NULL, 10);
+  if (errno == ERANGE) {
+    return 0;
+  }
+  *value = (int64_t)parsed;
+  return 1;
+}
+
+// Converts number text without requiring it to be NUL-terminated
+double json_slice_to_double(Slice number)
+{
+  char buffer[64];
+  char *text = buffer;
+  double value;
+
+  if (number.length >= sizeof(buffer) && !slice_to_owned(number, &text)) {
+    return 0;
+  }
+  if (text == buffer) {
+    memcpy(buffer, number.data, number.length);
+    buffer[number.length] = '\0';
+  }
+  value = strtod(text, NULL);
+  if (text != buffer) {
+    free(text);
+  }
+  return value;
+}
+
+int parse(json_parser *parser, Json_node *node)
+{
+  skip_white_space(&parser->lexer);
+  node->offset = parser->lexer.pos;
+  Json_token token = next_token(&parser->lexer);
+  switch (token.type) {
+    case JSON_TOKEN_CURLY_LBRACE:
+      {
+        if (!parse_object(parser, node)) {
+          return 0;
+        }
+      }
+      break;
+    case JSON_TOKEN_SQUARE_LBRACE:
+      {
+        if (!parse_array(parser, node)) {
+          return 0;
+        }
+      }
+      break;
+    case JSON_TOKEN_STRING:
+      {
+        node->type = JSON_NODE_STRING;
+        if (token.literal.length <= JSON_INLINE_STRING_CAPACITY) {
+          node->flags |= JSON_NODE_FLAG_INLINE;
+          memcpy(node->inline_string.data, token.literal.data, token.literal.length);
+          node->inline_string.data[token.literal.length] = '\0';
+          node->inline_string.length = (unsigned char)token.literal.length;
+        } else if (!slice_to_owned(token.literal, &node->string_value)) {
+          printf("ERROR! Couldn't allocate memory for string\n");
+          return 0;
+        }
+      }
+      break;
+    case JSON_TOKEN_NUMBER:
+      {
+        node->type = JSON_NODE_NUMBER;
+        if (parser->flags & JSON_PARSE_LAZY_NUMBERS) {
+          node->flags |= JSON_NODE_FLAG_LAZY_NUMBER;
+          if (!(parser->flags & JSON_PARSE_EDITABLE)) {
+            node->lazy_number.raw = token.literal;
+          } else if (token.literal.length <= sizeof(node->lazy_number.text)) {
+            // Edits move the source around, so editable documents keep a copy
+            node->flags |= JSON_NODE_FLAG_INLINE;
+            memcpy(node->lazy_number.text, token.literal.data, token.literal.length);
+          } else if (slice_to_owned(token.literal, &node->lazy_number.raw.data)) {
+            node->flags |= JSON_NODE_FLAG_NUMBER_OWNED;
+            node->lazy_number.raw.length = token.literal.length;
+          } else {
+            printf("ERROR! Couldn't allocate memory for number\n");
+            return 0;
+          }
+        } else {
+          node->number_value = json_slice_to_double(token.literal);
+        }
+      }
+      break;
+    case JSON_TOKEN_BOOLEAN:
+      {
+        node->type = JSON_NODE_BOOLEAN;
+        node->bool_value = slice_equals(token.literal, _slice("true"));
+      }
+      break;
+    case JSON_TOKEN_NULL:
+      {
+        node->type = JSON_NODE_NULL;
+      }
+      break;
+    case JSON_TOKEN_EOF:
+      {
+        return 1;
+      }
+    default:
+      {
+        printf("ERROR! Unexpected token while parsing\n");
+        print_token(&token);
+        return 0;
+      }
+      break;
+  }
+  node->length = parser->lexer.pos - node->offset;
+  return 1;
+}
+
+int json_parse(json_parser *parser, const char *file_path, Json_object *obj)
+{
+  if (!json_load_file(&parser->lexer, file_path))
+  {
+    return 0;
+  }
+
+  memset(&obj->root, 0, sizeof(obj->root));
+  if (!parse(parser, &obj->root)) {
+    // Left empty, callers may still unload the object
+    json_free(&obj->root);
+    memset(&obj->root, 0, sizeof(obj->root));
+    free(parser->lexer.content);
+    return 0;
+  }
+
+  obj->flags = parser->flags;
+  if (parser->flags & JSON_PARSE_KEEP_SOURCE) {
+    obj->source = parser->lexer.content;
+    obj->source_length = parser->lexer.length;
+  } else {
+    free(parser->lexer.content);
+  }
+  return 1;
+}
+
+// Parses a document from a caller-owned buffer. The buffer only has to
+// outlive the call, editable and lazy documents keep their own copy of it.
+int json_parse_buffer(json_parser *parser, const char *buf, size_t length, Json_object *obj)
+{
+  char *content = (char *)buf;
+  if (parser->flags & JSON_PARSE_KEEP_SOURCE) {
+    content = (char *)malloc(length + 1);
+    if (!content) {
+      fprintf(stderr, "ERROR! Couldn't allocate memory for document source\n");
+      return 0;
+    }
+    memcpy(content, buf, length);
+    content[length] = '\0';
+  }
+
+  parser->lexer.content = content;
+  init_lexer(&parser->lexer, length);
+  memset(&obj->root, 0, sizeof(obj->root));
+  if (!parse(parser, &obj->root)) {
+    // Left empty, callers may still unload the object
+    json_free(&obj->root);
+    memset(&obj->root, 0, sizeof(obj->root));
+    if (content != buf) {
+      free(content);
+    }
+    return 0;
+  }
+
+  obj->flags = parser->flags;
+  if (parser->flags & JSON_PARSE_KEEP_SOURCE) {
+    obj->source = content;
+    obj->source_length = length;
+  }
+  return 1;
+}
+
+// Parses a document that is pulled from source while parsing. Lazy numbers
+// and editing need the whole source kept, so those flags are refused here.
+int json_parse_source(json_parser *parser, Json_source *source, Json_object *obj)
+{
+  if (parser->flags & JSON_PARSE_KEEP_SOURCE) {
+    fprintf(stderr, "ERROR! Streamed documents can't keep their source\n");
+    return 0;
+  }
+
+  parser->lexer.content = source->data;
+  init_lexer(&parser->lexer, source->length);
+  parser->lexer.source = source;
+  parser->lexer.read_pos = 0;
+  advance(&parser->lexer);
+  memset(&obj->root, 0, sizeof(obj->root));
+  int ok = parse(parser, &obj->root);
+  parser->lexer.source = NULL;
+  if (!ok) {
+    json_free(&obj->root);
+    memset(&obj->root, 0, sizeof(obj->root));
+    return 0;
+  }
+  obj->flags = parser->flags;
+  return 1;
+}
+
+const char *json_string_value(Json_node *node)
+{
+  return (node->flags & JSON_NODE_FLAG_INLINE) ? node->inline_string.data : node->string_value;
+}
+
+// Original text of a lazy number, wherever it is kept
+Slice json_lazy_raw(Json_node *node)
+{
+  if (node->flags & JSON_NODE_FLAG_INLINE) {
+    return (Slice){.data = node->lazy_number.text, .length = node->length};
+  }
+  return node->lazy_number.raw;
+}
+
+// Converts a lazy number once, keeping integer text as an exact int64_t
+void json_number_convert(Json_node *node)
+{
+  if (node->flags & (JSON_NODE_FLAG_NUMBER_CACHED | JSON_NODE_FLAG_NUMBER_INTEGER)) {
+    return;
+  }
+  Slice raw = json_lazy_raw(node);
+  if (json_slice_to_int64(raw, &node->lazy_number.integer)) {
+    node->flags |= JSON_NODE_FLAG_NUMBER_INTEGER;
+  } else {
+    node->lazy_number.value = json_slice_to_double(raw);
+    node->flags |= JSON_NODE_FLAG_NUMBER_CACHED;
+  }
+}
+
+// Lazy numbers are converted on first access and cached in the node, so
+// concurrent first reads of the same node need external synchronization
+double json_number_value(Json_node *node)
+{
+  if (!(node->flags & (JSON_NODE_FLAG_LAZY_NUMBER | JSON_NODE_FLAG_NUMBER_INTEGER))) {
+    return node->number_value;
+  }
+  json_number_convert(node);
+  if (node->flags & JSON_NODE_FLAG_NUMBER_INTEGER) {
+    return (double)node->lazy_number.integer;
+  }
+  return node->lazy_number.value;
+}
+
+// Fails when the number isn't an integer or doesn't fit in int64_t. Lazy
+// numbers are read from their text and packed integers keep their value,
+// so integers above 2^53 stay exact.
+int json_number_int64(Json_node *node, int64_t *value)
+{
+  if (node->flags & (JSON_NODE_FLAG_LAZY_NUMBER | JSON_NODE_FLAG_NUMBER_INTEGER)) {
+    json_number_convert(node);
+    if (!(node->flags & JSON_NODE_FLAG_NUMBER_INTEGER)) {
+      return 0;
+    }
+    *value = node->lazy_number.integer;
+    return 1;
+  }
+
+  double number = node->number_value;
+  if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0) ||
+      (double)(int64_t)number != number) {
+    return 0;
+  }
+  *value = (int64_t)number;
+  return 1;
+}
+
+// Original text of a lazily parsed number, slice_null otherwise
+Slice json_number_raw(Json_node *node)
+{
+  if (node->flags & JSON_NODE_FLAG_LAZY_NUMBER) {
+    return json_lazy_raw(node);
+  }
+  return slice_null;
+}
+
+void json_free(Json_node *node) 
+{
+  switch (node->type) {
+    case JSON_NODE_ARRAY:
+      {
+        if (node->flags & JSON_NODE_FLAG_PACKED) {
+          // Left as an empty array, so freeing the node again is harmless
+          free(node->packed.items);
+          node->packed.items = NULL;
+          node->packed.size = 0;
+          node->flags &= ~JSON_NODE_FLAG_PACKED;
+          break;
+        }
+        for (size_t i = 0; i < node->array.size; i++) {
+          json_free(&node->array.items[i]);
+        }
+        Json_node_vector_deallocate(&node->array);
+      }
+      break;
+    case JSON_NODE_STRING:
+      {
+        if (!(node->flags & JSON_NODE_FLAG_INLINE)) {
+          free(node->string_value);
+        }
+      }
+      break;
+    case JSON_NODE_NUMBER:
+      {
+        if (node->flags & JSON_NODE_FLAG_NUMBER_OWNED) {
+          free(node->lazy_number.raw.data);
+        }
+      }
+      break;
+    case JSON_NODE_OBJECT:
+      {
+        for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+          for (Json_node_mapEntry *entry = node->map.buckets[i]; entry; entry = entry->next) {
+            free(entry->key);
+            json_free(&entry->value);
+          }
+        }
+        Json_node_map_deallocate(&node->map);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void json_unload(Json_object *obj)
+{
+  json_free(&obj->root);
+  free(obj->source);
+  obj->source = NULL;
+  obj->source_length = 0;
+  obj->source_capacity = 0;
+}
+
+#define JSON_EDIT_MAX_DEPTH 256
+
+int json_is_container(Json_node *node)
+{
+  return node->type == JSON_NODE_OBJECT || node->type == JSON_NODE_ARRAY;
+}
+
+// Returns the child container of node whose delimiters strictly enclose
+// [begin, end). Array elements are in source order, so they are searched by
+// offset; object members aren't, they are scanned.
+Json_node *json_child_enclosing(Json_node *node, size_t node_start, size_t begin, size_t end)
+{
+  if (node->type == JSON_NODE_ARRAY && !(node->flags & JSON_NODE_FLAG_PACKED)) {
+    size_t low = 0;
+    size_t high = node->array.size;
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      if (node_start + node->array.items[middle].offset < begin) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    if (low > 0) {
+      Json_node *child = &node->array.items[low - 1]; // Last element starting before begin
+      if (json_is_container(child) && end < node_start + child->offset + child->length) {
+        return child;
+      }
+    }
+  } else if (node->type == JSON_NODE_OBJECT) {
+    for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+      for (Json_node_mapEntry *entry = node->map.buckets[i]; entry; entry = entry->next) {
+        Json_node *child = &entry->value;
+        size_t start = node_start + child->offset;
+        if (json_is_container(child) && begin > start && end < start + child->length) {
+          return child;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+// Moves every sibling placed after child by the size difference of an edit
+void json_shift_siblings(Json_node *node, Json_node *child, size_t grow, size_t shrink)
+{
+  if (node->type == JSON_NODE_ARRAY && !(node->flags & JSON_NODE_FLAG_PACKED)) {
+    for (size_t i = (size_t)(child - node->array.items) + 1; i < node->array.size; i++) {
+      Json_node *sibling = &node->array.items[i];
+      sibling->offset = sibling->offset + grow - shrink;
+    }
+  } else if (node->type == JSON_NODE_OBJECT) {
+    for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+      for (Json_node_mapEntry *entry = node->map.buckets[i]; entry; entry = entry->next) {
+        Json_node *sibling = &entry->value;
+        if (sibling->offset > child->offset) {
+          sibling->offset = sibling->offset + grow - shrink;
+        }
+      }
+    }
+  }
+  node->length = node->length + grow - shrink;
+}
+
+int json_reparse_document(Json_object *obj, char *source, size_t length)
+{
+  json_parser parser = {0};
+  parser.flags = obj->flags;
+  parser.lexer.content = source;
+  init_lexer(&parser.lexer, length);
+
+  Json_node root = {0};
+  if (!parse(&parser, &root)) {
+    json_free(&root);
+    return 0;
+  }
+  json_free(&obj->root);
+  obj->root = root;
+  return 1;
+}
+
+// Replaces `removed` bytes at `offset` of the document source with `text` and
+// reparses only the smallest container enclosing the edit, splicing the new
+// subtree in place. Falls back to a full reparse when the edit touches the
+// delimiters of the root or changes the structure around the container.
+// The source is spliced in place and restored when the edit doesn't parse.
+int json_edit(Json_object *obj, size_t offset, size_t removed, const char *text, size_t text_length)
+{
+  if (!(obj->flags & JSON_PARSE_EDITABLE)) {
+    fprintf(stderr, "ERROR! Document wasn't parsed with JSON_PARSE_EDITABLE\n");
+    return 0;
+  }
+  if (offset > obj->source_length || removed > obj->source_length - offset) {
+    fprintf(stderr, "ERROR! Edit range is out of bounds\n");
+    return 0;
+  }
+
+  size_t old_length = obj->source_length;
+  size_t length = old_length - removed + text_length;
+  size_t capacity = obj->source_capacity > old_length ? obj->source_capacity : old_length + 1;
+  char *saved = NULL; // The removed bytes, to undo the splice
+  if (removed > 0) {
+    saved = (char *)malloc(removed);
+    if (!saved) {
+      fprintf(stderr, "ERROR! Couldn't allocate memory for edited source\n");
+      return 0;
+    }
+    memcpy(saved, obj->source + offset, removed);
+  }
+  if (length + 1 > capacity) {
+    size_t grown = capacity * 2 > length + 1 ? capacity * 2 : length + 1;
+    char *source = (char *)realloc(obj->source, grown);
+    if (!source) {
+      fprintf(stderr, "ERROR! Couldn't allocate memory for edited source\n");
+      free(saved);
+      return 0;
+    }
+    obj->source = source;
+    obj->source_capacity = grown;
+  }
+  char *source = obj->source;
+  size_t end = offset + removed;
+  memmove(source + offset + text_length, source + end, old_length - end);
+  memcpy(source + offset, text, text_length);
+  source[length] = '\0';
+  obj->source_length = length;
+
+  Json_node *path[JSON_EDIT_MAX_DEPTH];
+  size_t depth = 0;
+  Json_node *target = &obj->root;
+  size_t target_start = target->offset;
+
+  int local = json_is_container(target) && offset > target_start && end < target_start + target->length;
+  while (local) {
+    path[depth++] = target;
+    if (depth == JSON_EDIT_MAX_DEPTH) {
+      break;
+    }
+    Json_node *child = json_child_enclosing(target, target_start, offset, end);
+    if (!child) {
+      break;
+    }
+    target = child;
+    target_start += child->offset;
+  }
+
+  if (local) {
+    size_t target_end = target_start + target->length - removed + text_length;
+    json_parser parser = {0};
+    parser.flags = obj->flags;
+    parser.lexer.content = source;
+    parser.lexer.length = length;
+    parser.lexer.read_pos = target_start;
+    advance(&parser.lexer);
+
+    Json_node replacement = {0};
+    if (parse(&parser, &replacement) && replacement.type == target->type &&
+        replacement.offset == target_start && target_start + replacement.length == target_end) {
+      replacement.offset = target->offset;
+      json_free(target);
+      *target = replacement;
+      for (size_t i = depth - 1; i > 0 && text_length != removed; i--) {
+        json_shift_siblings(path[i - 1], path[i], text_length, removed);
+      }
+    } else {
+      json_free(&replacement);
+      local = 0;
+    }
+  }
+
+  if (!local && !json_reparse_document(obj, source, length)) {
+    memmove(source + end, source + offset + text_length, old_length - end);
+    if (removed > 0) {
+      memcpy(source + offset, saved, removed);
+    }
+    source[old_length] = '\0';
+    obj->source_length = old_length;
+    free(saved);
+    return 0;
+  }
+  free(saved);
+  return 1;
+}
+
+int json_search_key(Json_node* root, char* key, Json_node** value)
+{
+  if (!root || !key || !*key || !value) {
+    fprintf(stderr, "Error! Some parameter are missing\n");
+    return 0;
+  }
+
+  *value = Json_node_map_search(&root->map, key);
+  if (*value == NULL) {
+    fprintf(stderr, "ERROR! key \"%s\" doesn't exist\n", key);
+    return 0;
+  }
+  return 1;
+}
+
+size_t json_array_size(Json_node *node)
+{
+  return (node->flags & JSON_NODE_FLAG_PACKED) ? node->packed.size : node->array.size;
+}
+
+// Returns the element at index, or NULL when it's out of range. Elements of
+// packed arrays are built in scratch; without one they can't be returned.
+Json_node *json_array_at(Json_node *node, size_t index, Json_node *scratch)
+{
+  if (!(node->flags & JSON_NODE_FLAG_PACKED)) {
+    return index < node->array.size ? &node->array.items[index] : NULL;
+  }
+  if (index >= node->packed.size || !scratch) {
+    return NULL;
+  }
+
+  memset(scratch, 0, sizeof(*scratch));
+  switch (node->packed.type) {
+    case JSON_PACKED_DOUBLE:
+      scratch->type = JSON_NODE_NUMBER;
+      scratch->number_value = ((double *)node->packed.items)[index];
+      break;
+    case JSON_PACKED_INT64:
+      // Exact, like a converted lazy number without its text
+      scratch->type = JSON_NODE_NUMBER;
+      scratch->flags = JSON_NODE_FLAG_NUMBER_INTEGER;
+      scratch->lazy_number.integer = ((int64_t *)node->packed.items)[index];
+      break;
+    case JSON_PACKED_BOOLEAN:
+      scratch->type = JSON_NODE_BOOLEAN;
+      scratch->bool_value = (((uint64_t *)node->packed.items)[index / 64] >> (index % 64)) & 1;
+      break;
+  }
+  return scratch;
+}
+
+void json_array_iterator_init(Json_array_iterator *it, Json_node *node)
+{
+  it->array = node;
+  it->index = 0;
+}
+
+// Returns NULL once every element was visited
+Json_node *json_array_next(Json_array_iterator *it)
+{
+  if (it->index >= json_array_size(it->array)) {
+    return NULL;
+  }
+  return json_array_at(it->array, it->index++, &it->scratch);
+}
+
+// Looks up a path such as ".work.skills[0]" (the leading dot is optional).
+// Unlike json_search_key a missing path is not reported as an error.
+// Elements of packed arrays can only be reached through json_query_at.
+int json_query(Json_node *root, const char *path, Json_node **value)
+{
+  return json_query_at(root, path, NULL, value);
+}
+
+// Like json_query, building a packed array element in scratch when the path
+// ends at one
+int json_query_at(Json_node *root, const char *path, Json_node *scratch, Json_node **value)
+{
+  Json_node *node = root;
+  const char *p = path;
+
+  while (*p) {
+    if (*p == '[') {
+      char *end;
+      unsigned long index = strtoul(p + 1, &end, 10);
+      if (end == p + 1 || *end != ']' || node->type != JSON_NODE_ARRAY) {
+        return 0;
+      }
+      node = json_array_at(node, index, scratch);
+      if (!node) {
+        return 0;
+      }
+      p = end + 1;
+    } else {
+      if (*p == '.') {
+        p++;
+      }
+      size_t len = strcspn(p, ".[");
+      if (len == 0) {
+        continue;
+      }
+      if (node->type != JSON_NODE_OBJECT) {
+        return 0;
+      }
+      char *key;
+      if (!slice_to_owned((Slice){.data = (char *)p, .length = len}, &key)) {
+        return 0;
+      }
+      node = Json_node_map_search(&node->map, key);
+      free(key);
+      if (!node) {
+        return 0;
+      }
+      p += len;
+    }
+  }
+
+  *value = node;
+  return 1;
+}
+
+int json_write_raw(Vector *out, const char *str)
+{
+  return vector_append(out, (void *)str, strlen(str));
+}
+
+int json_write_string(Vector *out, const char *str)
+{
+  return json_write_raw(out, "\"") && json_write_raw(out, str) && json_write_raw(out, "\"");
+}
+
+// Shortest of %.15g and %.17g that reads back as the same double
+int json_write_double(Vector *out, double value)
+{
+  char number[32];
+  if (!isfinite(value)) {
+    return json_write_raw(out, "null");
+  }
+  snprintf(number, sizeof(number), "%.15g", value);
+  if (strtod(number, NULL) != value) {
+    snprintf(number, sizeof(number), "%.17g", value);
+  }
+  return json_write_raw(out, number);
+}
+
+int json_write_int64(Vector *out, int64_t value)
+{
+  char number[32];
+  snprintf(number, sizeof(number), "%lld", (long long)value);
+  return json_write_raw(out, number);
+}
+
+int json_write_packed(Vector *out, Json_node *node)
+{
+  for (size_t i = 0; i < node->packed.size; i++) {
+    int ok = i == 0 || json_write_raw(out, ",");
+    switch (node->packed.type) {
+      case JSON_PACKED_DOUBLE:
+        ok = ok && json_write_double(out, ((double *)node->packed.items)[i]);
+        break;
+      case JSON_PACKED_INT64:
+        ok = ok && json_write_int64(out, ((int64_t *)node->packed.items)[i]);
+        break;
+      case JSON_PACKED_BOOLEAN:
+        ok = ok && json_write_raw(out, ((((uint64_t *)node->packed.items)[i / 64] >> (i % 64)) & 1) ? "true" : "false");
+        break;
+    }
+    if (!ok) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Serializes node as minified JSON into a Vector of char. Strings are kept
+// with their original escapes; object keys come out in hashmap order.
+int json_write(Vector *out, Json_node *node)
+{
+  switch (node->type) {
+    case JSON_NODE_STRING:
+      return json_write_string(out, json_string_value(node));
+    case JSON_NODE_NUMBER:
+      {
+        if (node->flags & JSON_NODE_FLAG_LAZY_NUMBER) {
+          Slice raw = json_lazy_raw(node);
+          return vector_append(out, raw.data, raw.length);
+        }
+        if (node->flags & JSON_NODE_FLAG_NUMBER_INTEGER) {
+          return json_write_int64(out, node->lazy_number.integer);
+        }
+        return json_write_double(out, node->number_value);
+      }
+    case JSON_NODE_BOOLEAN:
+      return json_write_raw(out, node->bool_value ? "true" : "false");
+    case JSON_NODE_NULL:
+      return json_write_raw(out, "null");
+    case JSON_NODE_ARRAY:
+      {
+        if (!json_write_raw(out, "[")) {
+          return 0;
+        }
+        if (node->flags & JSON_NODE_FLAG_PACKED) {
+          return json_write_packed(out, node) && json_write_raw(out, "]");
+        }
+        for (size_t i = 0; i < node->array.size; i++) {
+          if ((i > 0 && !json_write_raw(out, ",")) || !json_write(out, &node->array.items[i])) {
+            return 0;
+          }
+        }
+        return json_write_raw(out, "]");
+      }
+    case JSON_NODE_OBJECT:
+      {
+        int first = 1;
+        if (!json_write_raw(out, "{")) {
+          return 0;
+        }
+        for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+          for (Json_node_mapEntry *entry = node->map.buckets[i]; entry; entry = entry->next) {
+            if ((!first && !json_write_raw(out, ",")) ||
+                !json_write_string(out, entry->key) ||
+                !json_write_raw(out, ":") ||
+                !json_write(out, &entry->value)) {
+              return 0;
+            }
+            first = 0;
+          }
+        }
+        return json_write_raw(out, "}");
+      }
+  }
+  return 0;
+}
+
+void json_print_value(Json_node* value)
+{
+  switch (value->type) {
+    case JSON_NODE_STRING: {
+      printf("%s", json_string_value(value));
+    }
+    break; 
+    case JSON_NODE_BOOLEAN: {
+      printf("%s", value->bool_value ? "true" : "false");
+    }
+    break;
+    case JSON_NODE_NULL: {
+      printf("NULL");
+    }
+    break;
+    case JSON_NODE_NUMBER: {
+      printf("%2.f\n", json_number_value(value));
+    }
+    break;
+    case JSON_NODE_ARRAY: {
+      Json_array_iterator it;
+      json_array_iterator_init(&it, value);
+      for (Json_node *n = json_array_next(&it); n; n = json_array_next(&it)) {
+        json_print_value(n);
+        if (it.index != json_array_size(value)) {
+          printf(" ");
+        }
+      }
+    }
+    break;
+    case JSON_NODE_OBJECT: {
+        for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+          if (!value->map.buckets[i]) {
+            continue;
+          } else {
+            Json_node_mapEntry *entry = value->map.buckets[i];
+            while (entry) {
+              Json_node_mapEntry *temp = entry;
+              entry = entry->next;
+              Json_node *value = &temp->value;
+              printf("key: \"%s\" ", temp->key);
+              printf("value: \"");
+              json_print_value(value);
+              printf("\"");
+              printf("\n");
+            }
+          }
+        }
+      }
+    break;
+  }
+}
@@ -0,0 +1,171 @@
+#ifndef __JSON__
+#define __JSON__
+
+#include <stdint.h>
+
+#include "uds.h"
+
+typedef enum {
+  JSON_TOKEN_CURLY_LBRACE,
+  JSON_TOKEN_CURLY_RBRACE,
+  JSON_TOKEN_SQUARE_LBRACE,
+  JSON_TOKEN_SQUARE_RBRACE,
+  JSON_TOKEN_STRING,
+  JSON_TOKEN_NUMBER,
+  JSON_TOKEN_BOOLEAN,
+  JSON_TOKEN_NULL,
+  JSON_TOKEN_COMMA,
+  JSON_TOKEN_COLON,
+  JSON_TOKEN_EOF,
+  JSON_TOKEN_INVALID
+} JSON_TOKEN_TYPE;
+
+typedef struct JSON_Token {
+  JSON_TOKEN_TYPE type;
+  Slice literal;
+} Json_token;
+
+typedef enum JSON_NODE_TYPE
+{
+    JSON_NODE_OBJECT,
+    JSON_NODE_ARRAY,
+    JSON_NODE_STRING,
+    JSON_NODE_NUMBER,
+    JSON_NODE_BOOLEAN,
+    JSON_NODE_NULL
+} JSON_NODE_TYPE;
+
+#define JSON_INLINE_STRING_CAPACITY 22 // Longest string stored inside the node itself
+
+#define JSON_NODE_FLAG_INLINE (1u << 0) // String lives in inline_string instead of string_value, lazy number text in lazy_number.text
+#define JSON_NODE_FLAG_LAZY_NUMBER (1u << 1) // Number kept as lazy_number.raw until first access
+#define JSON_NODE_FLAG_NUMBER_CACHED (1u << 2) // lazy_number.value holds the converted raw text
+#define JSON_NODE_FLAG_PACKED (1u << 3) // Array elements live in packed instead of array
+#define JSON_NODE_FLAG_NUMBER_INTEGER (1u << 4) // lazy_number.integer holds the exact value, converted raw text or a packed element
+#define JSON_NODE_FLAG_NUMBER_OWNED (1u << 5) // lazy_number.raw was copied out of the source
+
+typedef enum JSON_PACKED_TYPE
+{
+    JSON_PACKED_DOUBLE,
+    JSON_PACKED_INT64,
+    JSON_PACKED_BOOLEAN
+} JSON_PACKED_TYPE;
+
+struct Json_node;
+
+VECTOR_DECLARE(Json_node_vector, struct Json_node)
+HASHMAP_DECLARE(Json_node_map, char *, struct Json_node)
+
+typedef struct Json_node
+{
+    JSON_NODE_TYPE type;
+    unsigned char flags;
+    size_t offset; // Source offset, relative to the parent node (absolute for the root)
+    size_t length; // Source length in bytes, delimiters included
+    union
+    {
+        Json_node_map map;
+        Json_node_vector array;
+        struct {
+            void *items; // double, int64_t, or uint64_t words holding one bit per boolean
+            size_t size;
+            JSON_PACKED_TYPE type;
+        } packed;
+        char *string_value;
+        struct {
+            char data[JSON_INLINE_STRING_CAPACITY + 1];
+            unsigned char length;
+        } inline_string;
+        double number_value;
+        struct {
+            union {
+                Slice raw;
+                char text[sizeof(Slice)]; // Node length bytes, for short numbers of editable documents
+            };
+            union {
+                double value;
+                int64_t integer;
+            };
+        } lazy_number;
+        int bool_value;
+    };
+} Json_node;
+
+VECTOR_DEFINE(Json_node_vector, Json_node)
+HASHMAP_DEFINE(Json_node_map, char *, Json_node, string_hash, string_compare)
+
+// Input that arrives in pieces. refill appends to data, which it may move,
+// and returns 0 once there is nothing left. Tokens are only sliced out of
+// data after their last byte was read, so a move never splits one.
+typedef struct Json_source {
+  char *data;
+  size_t length;
+  int (*refill)(struct Json_source *source);
+} Json_source;
+
+typedef struct json_lexer {
+  char *content;
+  size_t pos;
+  size_t read_pos;
+  size_t length;
+  char ch;
+  Json_source *source; // NULL when content holds the whole input
+} json_lexer;
+
+#define JSON_PARSE_EDITABLE (1u << 0) // Keep the source text so the document can be edited with json_edit
+#define JSON_PARSE_LAZY_NUMBERS (1u << 1) // Convert numbers on first access, keeping their original text
+#define JSON_PARSE_PACK_ARRAYS (1u << 2) // Store arrays of only numbers or only booleans packed, see json_array_at
+#define JSON_PARSE_KEEP_SOURCE (JSON_PARSE_EDITABLE | JSON_PARSE_LAZY_NUMBERS)
+
+typedef struct json_parser {
+  json_lexer lexer;
+  unsigned int flags;
+} json_parser;
+
+// Walks the elements of either array kind. Elements of a packed array are
+// copied into scratch, so a returned node is only valid until the next call.
+typedef struct Json_array_iterator {
+  Json_node *array;
+  size_t index;
+  Json_node scratch;
+} Json_array_iterator;
+
+typedef struct Json_object {
+  Json_node root;
+  char *source;
+  size_t source_length;
+  size_t source_capacity; // Of source, grown by json_edit
+  unsigned int flags;
+} Json_object;
+
+void advance(json_lexer *lexer);
+void init_lexer(json_lexer *lexer, size_t length);
+void skip_white_space(json_lexer *lexer);
+Json_token next_token(json_lexer *lexer);
+Json_token peek_token(json_lexer *lexer);
+char *json_token_type_to_string(JSON_TOKEN_TYPE type);
+void print_token(Json_token *token);
+
+int json_load_file(json_lexer *lexer, const char *file_path);
+int parse(json_parser *parser, Json_node *node);
+int json_parse(json_parser *parser, const char *file_path, Json_object *obj);
+int json_parse_buffer(json_parser *parser, const char *buf, size_t length, Json_object *obj);
+int json_parse_source(json_parser *parser, Json_source *source, Json_object *obj);
+const char *json_string_value(Json_node *node);
+double json_number_value(Json_node *node);
+int json_number_int64(Json_node *node, int64_t *value);
+Slice json_number_raw(Json_node *node);
+void json_free(Json_node *node);
+void json_unload(Json_object *obj);
+int json_edit(Json_object *obj, size_t offset, size_t removed, const char *text, size_t text_length);
+int json_search_key(Json_node* root, char* key, Json_node** value);
+int json_query(Json_node *root, const char *path, Json_node **value);
+int json_query_at(Json_node *root, const char *path, Json_node *scratch, Json_node **value);
+size_t json_array_size(Json_node *node);
+Json_node *json_array_at(Json_node *node, size_t index, Json_node *scratch);
+void json_array_iterator_init(Json_array_iterator *it, Json_node *node);
+Json_node *json_array_next(Json_array_iterator *it);
+int json_write(Vector *out, Json_node *node);
+void json_print_value(Json_node* value);
+
+#endif // __JSON__
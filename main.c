@@ -1,607 +1,844 @@
-#include <stdio.h>
-
-#include "uds.h"
+#define _POSIX_C_SOURCE 200809L
 
-#define COLOR_RESET   "\x1b[0m"
-#define COLOR_YELLOW  "\x1b[33m"
-#define COLOR_BLUE    "\x1b[34m"
-#define COLOR_RED     "\x1b[31m"
-#define COLOR_GREEN   "\x1b[32m"
+#include <stdio.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "columns.h"
+#include "filter.h"
+#include "follow.h"
+#include "json.h"
+#include "stream.h"
+#include "validate.h"
+
+#define CLI_MAX_THREADS 256
 
 typedef enum {
-  JSON_TOKEN_CURLY_LBRACE,
-  JSON_TOKEN_CURLY_RBRACE,
-  JSON_TOKEN_SQUARE_LBRACE,
-  JSON_TOKEN_SQUARE_RBRACE,
-  JSON_TOKEN_STRING,
-  JSON_TOKEN_NUMBER,
-  JSON_TOKEN_BOOLEAN,
-  JSON_TOKEN_NULL,
-  JSON_TOKEN_COMMA,
-  JSON_TOKEN_COLON,
-  JSON_TOKEN_EOF,
-  JSON_TOKEN_INVALID
-} JSON_TOKEN_TYPE;
-
-typedef struct JSON_Token {
-  JSON_TOKEN_TYPE type;
-  Slice literal;
-} Json_token;
-
-void print_token(Json_token *token);
-
-typedef enum JSON_NODE_TYPE
-{
-    JSON_NODE_OBJECT,
-    JSON_NODE_ARRAY,
-    JSON_NODE_STRING,
-    JSON_NODE_NUMBER,
-    JSON_NODE_BOOLEAN,
-    JSON_NODE_NULL
-} JSON_NODE_TYPE;
-
-typedef struct Json_node
-{
-    JSON_NODE_TYPE type;
-    union
-    {
-        HashMap map;
-        Vector array;
-        char *string_value;
-        double number_value;
-        int bool_value;
-    };
-} Json_node;
-
-typedef struct json_lexer {
-  char *content;
-  size_t pos;
-  size_t read_pos;
+  CLI_VALIDATE,
+  CLI_MINIFY,
+  CLI_PRETTY,
+  CLI_QUERY,
+  CLI_STATS,
+  CLI_FILTER,
+  CLI_COLUMNS,
+  CLI_FOLLOW
+} CLI_COMMAND;
+
+typedef struct Cli_options {
+  CLI_COMMAND command;
+  const char *path;
+  Json_filter filter;
+  Vector keys; // char *, keys selected by --keys
+  const char *checkpoint;
+  int ndjson;
+  int threads;
+} Cli_options;
+
+typedef struct Cli_input {
+  char *data;
   size_t length;
-  char ch;
-} json_lexer;
-
-typedef struct json_parser {
-  json_lexer lexer;
-} json_parser;
-
-typedef struct Json_object {
-  Json_node root;
-} Json_object;
-
-void advance(json_lexer *lexer)
+  int mapped;
+} Cli_input;
+
+typedef struct Json_stats {
+  size_t documents;
+  size_t bytes;
+  size_t objects;
+  size_t arrays;
+  size_t keys;
+  size_t strings;
+  size_t numbers;
+  size_t booleans;
+  size_t nulls;
+  size_t max_depth;
+} Json_stats;
+
+typedef struct Cli_error {
+  size_t line; // Relative to the start of the job
+  size_t column;
+  const char *message;
+} Cli_error;
+
+// A contiguous run of documents handled by one thread
+typedef struct Cli_job {
+  const Cli_options *options;
+  const char *data;
+  size_t length;
+  size_t lines;
+  Vector output; // char
+  Vector errors; // Cli_error
+  Json_stats stats;
+  size_t line_base; // Added to the line numbers json_filter_scan reports
+  int ok;
+} Cli_job;
+
+typedef struct Cli_follow {
+  const char *name;
+  Vector output; // char
+  int ok;
+} Cli_follow;
+
+volatile sig_atomic_t cli_stop = 0;
+
+void usage(const char *program)
 {
-  if (lexer->read_pos >= lexer->length) {
-    lexer->ch = EOF;
-  } else {
-    lexer->ch = lexer->content[lexer->read_pos];
-  }
-  lexer->pos = lexer->read_pos;
-  lexer->read_pos++;
+  fprintf(stderr,
+          "usage: %s <command> [options] [file...]\n"
+          "\n"
+          "Reads every file (or stdin when no file or \"-\" is given), gzip or zstd\n"
+          "compressed input is detected and decompressed on the fly.\n"
+          "\n"
+          "commands:\n"
+          "  validate        check that the input is valid JSON\n"
+          "  minify          print the input without insignificant whitespace\n"
+          "  pretty          print the input indented\n"
+          "  query <path>    print the value at path, e.g. .work.skills[0]\n"
+          "  stats           print document statistics\n"
+          "  filter          print the NDJSON records matching every predicate\n"
+          "  columns         extract an array of records into columns and summarize them\n"
+          "  follow          print NDJSON records as they are appended to a file, until interrupted\n"
+          "\n"
+          "options:\n"
+          "  --ndjson        treat every line as a separate document\n"
+          "  --threads <n>   worker threads for --ndjson input or columns (default 1)\n"
+          "  --keys <a,b,..> columns to extract (default: every key)\n"
+          "  --checkpoint <file>  where follow saves its offset, to resume after a restart\n"
+          "\n"
+          "filter predicates, on top-level keys:\n"
+          "  --has <key>             key exists\n"
+          "  --eq <key>=<string>     key equals string\n"
+          "  --num <key>=<number>    key equals number\n"
+          "  --range <key>=<min>:<max>  key is a number in [min, max]\n",
+          program);
 }
 
-void init_lexer(json_lexer *lexer, size_t length)
+// Whole documents and columns need the input in one buffer, it's collected
+// while the stream decompresses on its own thread
+int read_stream(int fd, Cli_input *input)
 {
-  lexer->length = length;
-  lexer->pos = 0;
-  lexer->read_pos= 0;
-  advance(lexer);
+  Json_stream stream;
+  input->mapped = 0;
+  if (!json_stream_open_fd(&stream, fd)) {
+    return 0;
+  }
+  int ok = json_stream_read_all(&stream, &input->data, &input->length);
+  ok &= json_stream_close(&stream);
+  if (!ok) {
+    fprintf(stderr, "ERROR! Couldn't read the whole input\n");
+  }
+  return ok;
 }
 
-int json_load_file(json_lexer *lexer, const char *file_path)
+// Uncompressed regular files are mapped, anything else is handed back as
+// a descriptor to read through a stream
+int open_input(const char *path, Cli_input *input, int *stream_fd)
 {
-  FILE *f = fopen(file_path, "rb");
-  if (!f) {
-    fprintf(stderr, "ERROR! can't open file %s\n", file_path);
-    return 0;
+  input->mapped = 0;
+  if (strcmp(path, "-") == 0) {
+    *stream_fd = dup(STDIN_FILENO);
+    if (*stream_fd < 0) {
+      perror("dup");
+      return 0;
+    }
+    return 1;
   }
-  fseek(f, 0, SEEK_END);
-  size_t content_len = ftell(f);
-  rewind(f);
 
-  lexer->content = (char *)malloc(content_len + 1);
-  if (!lexer->content) {
-    fprintf(stderr, "ERROR! Couldn't allocate memory for file %s\n", file_path);
-    fclose(f);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR! can't open file %s\n", path);
     return 0;
   }
 
-  size_t bytes_read = fread(lexer->content, 1, content_len, f);
-  lexer->content[bytes_read] = '\0';
-  fclose(f);
+  struct stat st;
+  unsigned char magic[4];
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    void *data = MAP_FAILED;
+    if (n >= 0 && json_detect_compression(magic, (size_t)n) == JSON_COMPRESSION_NONE) {
+      data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (data != MAP_FAILED) {
+      posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+      input->data = (char *)data;
+      input->length = (size_t)st.st_size;
+      input->mapped = 1;
+      close(fd);
+      return 1;
+    }
+  }
 
-  init_lexer(lexer, bytes_read);
+  *stream_fd = fd;
   return 1;
 }
 
-void skip_white_space(json_lexer *lexer)
+void release_input(Cli_input *input)
 {
-    while (isspace(lexer->ch))
-    {
-        advance(lexer);
-    }
+  if (input->mapped) {
+    munmap(input->data, input->length);
+  } else {
+    free(input->data);
+  }
 }
 
-Slice read_string(json_lexer *lexer)
+// Collects statistics from text that already passed json_validate
+void stats_scan(const char *s, size_t length, Json_stats *stats)
 {
-  size_t start = lexer->pos + 1;
-  advance(lexer);
-  while (lexer->ch != '"' && lexer->ch != '\0')
-  {
-      advance(lexer);
-  }
-
-  size_t len = lexer->pos - start;
-  Slice str = {
-      .data = lexer->content + start,
-      .length = len};
-  return str;
+  size_t depth = 0;
+
+  stats->documents++;
+  stats->bytes += length;
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    if (c == '{' || c == '[') {
+      if (c == '{') {
+        stats->objects++;
+      } else {
+        stats->arrays++;
+      }
+      depth++;
+      if (depth > stats->max_depth) {
+        stats->max_depth = depth;
+      }
+    } else if (c == '}' || c == ']') {
+      depth--;
+    } else if (c == '"') {
+      size_t j = i;
+      json_skip_value(s, length, &j);
+      i = j - 1;
+      while (j < length && json_is_space(s[j])) {
+        j++;
+      }
+      if (j < length && s[j] == ':') {
+        stats->keys++;
+      } else {
+        stats->strings++;
+      }
+    } else if (c == 't' || c == 'f') {
+      stats->booleans++;
+      i += c == 't' ? 3 : 4;
+    } else if (c == 'n') {
+      stats->nulls++;
+      i += 3;
+    } else if (c == '-' || isdigit((unsigned char)c)) {
+      stats->numbers++;
+      while (i + 1 < length && (isdigit((unsigned char)s[i + 1]) || strchr("+-.eE", s[i + 1]))) {
+        i++;
+      }
+    }
+  }
 }
 
-Slice read_number(json_lexer *lexer)
+void stats_merge(Json_stats *dst, const Json_stats *src)
 {
-  size_t start = lexer->pos;
-  while (isdigit(lexer->ch) || lexer->ch == '.' || lexer->ch == '-') {
-      advance(lexer);
+  dst->documents += src->documents;
+  dst->bytes += src->bytes;
+  dst->objects += src->objects;
+  dst->arrays += src->arrays;
+  dst->keys += src->keys;
+  dst->strings += src->strings;
+  dst->numbers += src->numbers;
+  dst->booleans += src->booleans;
+  dst->nulls += src->nulls;
+  if (src->max_depth > dst->max_depth) {
+    dst->max_depth = src->max_depth;
   }
+}
 
-  size_t len = lexer->pos - start;
-  Slice number = {
-      .data = lexer->content + start,
-      .length = len
-  };
-  return number;
+int write_indent(Vector *out, size_t depth)
+{
+  if (!vector_append(out, "\n", 1)) {
+    return 0;
+  }
+  for (size_t i = 0; i < depth; i++) {
+    if (!vector_append(out, "  ", 2)) {
+      return 0;
+    }
+  }
+  return 1;
 }
 
-Slice read_keyword(json_lexer *lexer)
+// Re-emits validated text token by token, so key order and number
+// spelling are preserved exactly
+int format_document(Vector *out, const char *s, size_t length, int pretty)
 {
-  size_t start = lexer->pos;
-  while (isalpha(lexer->ch))
-  {
-      advance(lexer);
+  size_t depth = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    if (json_is_space(c)) {
+      continue;
+    }
+
+    if (c == '"') {
+      size_t end = i;
+      json_skip_value(s, length, &end);
+      if (!vector_append(out, (void *)(s + i), end - i)) {
+        return 0;
+      }
+      i = end - 1;
+    } else if (c == '{' || c == '[') {
+      if (!vector_append(out, &c, 1)) {
+        return 0;
+      }
+      size_t j = i + 1;
+      while (j < length && json_is_space(s[j])) {
+        j++;
+      }
+      if (s[j] == '}' || s[j] == ']') {
+        if (!vector_append(out, (void *)(s + j), 1)) {
+          return 0;
+        }
+        i = j;
+      } else {
+        depth++;
+        if (pretty && !write_indent(out, depth)) {
+          return 0;
+        }
+      }
+    } else if (c == '}' || c == ']') {
+      depth--;
+      if ((pretty && !write_indent(out, depth)) || !vector_append(out, &c, 1)) {
+        return 0;
+      }
+    } else if (c == ',') {
+      if (!vector_append(out, &c, 1) || (pretty && !write_indent(out, depth))) {
+        return 0;
+      }
+    } else if (c == ':') {
+      if (!vector_append(out, pretty ? ": " : ":", pretty ? 2 : 1)) {
+        return 0;
+      }
+    } else {
+      size_t end = i;
+      while (end < length && !json_is_space(s[end]) && !strchr(",:]}", s[end])) {
+        end++;
+      }
+      if (!vector_append(out, (void *)(s + i), end - i)) {
+        return 0;
+      }
+      i = end - 1;
+    }
   }
+  return vector_append(out, "\n", 1);
+}
 
-  size_t len = lexer->pos - start;
-  Slice keyword = {
-      .data = lexer->content + start,
-      .length = len};
-  return keyword;
+int query_document(Vector *out, const char *s, size_t length, const char *path)
+{
+  json_parser parser = {.flags = JSON_PARSE_LAZY_NUMBERS}; // Numbers are echoed as written
+  Json_object object = {0};
+  Json_node *node;
+
+  if (!json_parse_buffer(&parser, s, length, &object)) {
+    return 0;
+  }
+  int ok = json_query(&object.root, path, &node) ? json_write(out, node) : vector_append(out, "null", 4);
+  json_unload(&object);
+  return ok && vector_append(out, "\n", 1);
 }
 
-Json_token next_token(json_lexer *lexer)
+void process_document(Cli_job *job, const char *s, size_t length, size_t line)
 {
-  Json_token token;
-  skip_white_space(lexer);
-
-  switch (lexer->ch)
-  {
-    case '{':
-      token.type = JSON_TOKEN_CURLY_LBRACE;
-      token.literal = _slice("{");
-      advance(lexer);
-      break;
-    case '}':
-      token.type = JSON_TOKEN_CURLY_RBRACE;
-      token.literal = _slice("}");
-      advance(lexer);
-      break;
-    case '[':
-      token.type = JSON_TOKEN_SQUARE_LBRACE;
-      token.literal = _slice("[");
-      advance(lexer);
-      break;
-    case ']':
-      token.type = JSON_TOKEN_SQUARE_RBRACE;
-      token.literal = _slice("]");
-      advance(lexer);
-      break;
-    case ',':
-      token.type = JSON_TOKEN_COMMA;
-      token.literal = _slice(",");
-      advance(lexer);
+  Json_error error = {0};
+
+  if (!json_validate(s, length, &error)) {
+    Cli_error e = {.line = line + error.line - 1, .column = error.column, .message = error.message};
+    vector_push_back(&job->errors, &e);
+    job->ok = 0;
+    return;
+  }
+
+  int ok = 1;
+  switch (job->options->command) {
+    case CLI_VALIDATE:
+    case CLI_COLUMNS:
+    case CLI_FOLLOW:
       break;
-    case ':':
-      token.type = JSON_TOKEN_COLON;
-      token.literal = _slice(":");
-      advance(lexer);
+    case CLI_MINIFY:
+    case CLI_PRETTY:
+      ok = format_document(&job->output, s, length, job->options->command == CLI_PRETTY);
       break;
-    case '"':
-      token.type = JSON_TOKEN_STRING;
-      token.literal = read_string(lexer);
-      advance(lexer);
+    case CLI_QUERY:
+      ok = query_document(&job->output, s, length, job->options->path);
       break;
-    case EOF:
-      token.type = JSON_TOKEN_EOF;
-      token.literal = _slice("EOF");
-      advance(lexer);
+    case CLI_STATS:
+      stats_scan(s, length, &job->stats);
       break;
-    case '\n':
-    case '\r':
-    case '\t':
-      advance(lexer);
+    case CLI_FILTER:
+      ok = vector_append(&job->output, (void *)s, length) && vector_append(&job->output, "\n", 1);
       break;
-    default:
-      if (isdigit(lexer->ch) || lexer->ch == '-') {
-          token.type = JSON_TOKEN_NUMBER;
-          token.literal = read_number(lexer);
-      } else if (isalpha(lexer->ch)) {
-          token.literal = read_keyword(lexer);
-          if (slice_equals(token.literal, _slice("true")) || slice_equals(token.literal, _slice("false")))
-          {
-              token.type = JSON_TOKEN_BOOLEAN;
-          }
-          else if (slice_equals(token.literal, _slice("null")))
-          {
-              token.type = JSON_TOKEN_NULL;
-          }
-          else
-          {
-              token.type = JSON_TOKEN_INVALID;
-          }
-      }
-      else
-      {
-          token.type = JSON_TOKEN_INVALID;
-          token.literal = slice_null;
-      }
-    }
-  return token;
+  }
+  if (!ok) {
+    Cli_error e = {.line = line, .column = 1, .message = "Couldn't process document"};
+    vector_push_back(&job->errors, &e);
+    job->ok = 0;
+  }
 }
 
-
-char *json_token_type_to_string(JSON_TOKEN_TYPE type)
+int blank_line(const char *s, size_t length)
 {
-    switch (type)
-    {
-    case JSON_TOKEN_BOOLEAN:
-        return "BOOLEAN";
-    case JSON_TOKEN_COLON:
-        return "COLON";
-    case JSON_TOKEN_COMMA:
-        return "COMMA";
-    case JSON_TOKEN_CURLY_LBRACE:
-        return "CURLY_LBRACE";
-    case JSON_TOKEN_CURLY_RBRACE:
-        return "CURLY_RBRACE";
-    case JSON_TOKEN_EOF:
-        return "EOF";
-    case JSON_TOKEN_INVALID:
-        return "INVALID";
-    case JSON_TOKEN_NULL:
-        return "NULL";
-    case JSON_TOKEN_NUMBER:
-        return "NUMBER";
-    case JSON_TOKEN_SQUARE_LBRACE:
-        return "SQUARE_LBRACE";
-    case JSON_TOKEN_SQUARE_RBRACE:
-        return "SQUARE_RBRACE";
-    case JSON_TOKEN_STRING:
-        return "STRING";
-    default:
-      return NULL;
-    }
+  size_t i = 0;
+  while (i < length && json_is_space(s[i])) {
+    i++;
+  }
+  return i == length;
 }
 
-void print_token(Json_token *token)
+// Filtering works on raw bytes, only matching records get validated
+void filter_record(const char *record, size_t length, size_t line, void *user_data)
 {
-    char *type = json_token_type_to_string(token->type);
-    //printf(COLOR_RED"############# DEBUG TOKEN INFO #############"COLOR_RESET"\n");
-    //printf(COLOR_YELLOW "type: %s" COLOR_RESET " value: " COLOR_BLUE slice_fmt COLOR_RESET "\n", 
-    //       type, slice_args(token->literal));
-    //printf(COLOR_RED"############################################"COLOR_RESET"\n\n");
-    printf("############# DEBUG TOKEN INFO #############""\n");
-    printf("type: %s"" value: "slice_fmt"\n", 
-           type, slice_args(token->literal));
-    printf("############################################""\n\n");
+  Cli_job *job = (Cli_job *)user_data;
+  process_document(job, record, length, job->line_base + line);
 }
 
-Json_token peek_token(json_lexer *lexer)
+void *run_job(void *arg)
 {
-    json_lexer temp = *lexer;
-    return next_token(&temp);
-}
+  Cli_job *job = (Cli_job *)arg;
+
+  if (job->options->command == CLI_FILTER) {
+    json_filter_scan(&job->options->filter, job->data, job->length, filter_record, job, &job->lines);
+    return NULL;
+  }
+  if (!job->options->ndjson) {
+    process_document(job, job->data, job->length, 1);
+    return NULL;
+  }
 
-int parse(json_parser *parser, Json_node *node);
+  const char *p = job->data;
+  const char *end = job->data + job->length;
+  while (p < end) {
+    const char *newline = memchr(p, '\n', end - p);
+    const char *line_end = newline ? newline : end;
+    size_t length = line_end - p;
+    job->lines++;
 
+    if (length > 0 && p[length - 1] == '\r') {
+      length--;
+    }
+    if (!blank_line(p, length)) {
+      process_document(job, p, length, job->lines);
+    }
+    p = newline ? newline + 1 : end;
+  }
+  return NULL;
+}
 
-int parse_object(json_parser *parser, Json_node *node)
+// Writes a job's output and its errors, numbered from line
+void print_job(Cli_job *job, const char *name, size_t line)
 {
-  hashmap_new(&node->map, compare_strings, hash_string);
-  node->type = JSON_NODE_OBJECT;
+  fwrite(job->output.items, 1, job->output.size, stdout);
+  for (size_t i = 0; i < job->errors.size; i++) {
+    Cli_error *e = vector_get_ref_at(&job->errors, i);
+    fprintf(stderr, "%s:%zu:%zu: %s\n", name, line + e->line, e->column, e->message);
+  }
+}
 
-  while (peek_token(&parser->lexer).type != JSON_TOKEN_CURLY_RBRACE) {
-    Json_token key = next_token(&parser->lexer);
-    char *key_str;
+// Splits the input at line boundaries, runs one job per thread and prints
+// the results in input order
+int process_input(const Cli_options *options, const char *name, Cli_input *input, Json_stats *stats)
+{
+  Cli_job jobs[CLI_MAX_THREADS];
+  pthread_t threads[CLI_MAX_THREADS];
+  int started[CLI_MAX_THREADS] = {0};
+  size_t count = options->ndjson ? (size_t)options->threads : 1;
+  size_t start = 0;
+
+  if (count > 1 && input->length < count * 4096) {
+    count = 1;
+  }
 
-    if (key.type != JSON_TOKEN_STRING) {
-      printf("ERROR! Expected token string got %s\n", json_token_type_to_string(key.type));
-      return 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t end = i == count - 1 ? input->length : input->length / count * (i + 1);
+    if (end < start) {
+      end = start;
     }
-
-    if (!slice_to_owned(key.literal, &key_str)) {
-      printf("ERROR! Couldn't allocate memory for key string\n");
-      return 0;
+    const char *newline = memchr(input->data + end, '\n', input->length - end);
+    if (i != count - 1) {
+      end = newline ? (size_t)(newline - input->data) + 1 : input->length;
     }
 
-    Json_token expected = next_token(&parser->lexer);
-    if (expected.type != JSON_TOKEN_COLON) {
-      printf("ERROR! Expected token \":\" got %s\n", json_token_type_to_string(expected.type));
-      return 0;
-    }
+    Cli_job *job = &jobs[i];
+    memset(job, 0, sizeof(*job));
+    job->options = options;
+    job->data = input->data + start;
+    job->length = end - start;
+    job->ok = 1;
+    vector_new(&job->output, 1, 4096);
+    vector_new(&job->errors, sizeof(Cli_error), 1);
+    start = end;
+  }
 
-    Json_node value = {0};
-    if (!parse(parser, &value)) {
-      printf("ERROR! Couldn't parse object\n");
-      return 0;
+  for (size_t i = 1; i < count; i++) {
+    started[i] = pthread_create(&threads[i], NULL, run_job, &jobs[i]) == 0;
+    if (!started[i]) {
+      run_job(&jobs[i]);
     }
+  }
+  run_job(&jobs[0]);
 
-    Json_node *value_ptr = (Json_node *)malloc(sizeof(Json_node));
-    if (!value_ptr) {
-      printf("ERROR! Couldn't allocate memory for Json_node value\n");
-      return 0;
+  int ok = 1;
+  size_t line = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
     }
-    *value_ptr = value;
+    Cli_job *job = &jobs[i];
+    print_job(job, name, line);
+    stats_merge(stats, &job->stats);
+    ok &= job->ok;
+    line += job->lines;
+    vector_deallocate(&job->output);
+    vector_deallocate(&job->errors);
+  }
+  return ok;
+}
 
-    if (!hashmap_insert(&node->map, key_str, value_ptr)) {
-      free(value_ptr);
-      return 0;
-    }
+typedef struct Cli_lines {
+  Cli_job job;
+  const char *name;
+} Cli_lines;
 
-    Json_token peek = peek_token(&parser->lexer);
-    if (peek.type == JSON_TOKEN_CURLY_RBRACE) {
-      break;
-    } else if (peek.type == JSON_TOKEN_COMMA) {
-      next_token(&parser->lexer); // Consume ","
-    } else {
-      printf("ERROR! Expected token \",\" (COMMA) or \"}\" (CURLY_RBRACE), but got %s\n", json_token_type_to_string(peek.type));
-      print_token(&peek);
-      return 0;
-    }
+void process_line(const char *line, size_t length, size_t offset, void *user_data)
+{
+  Cli_lines *lines = (Cli_lines *)user_data;
+  Cli_job *job = &lines->job;
+  (void)offset;
+
+  job->lines++;
+  if (job->options->command == CLI_FILTER) {
+    job->line_base = job->lines - 1;
+    json_filter_scan(&job->options->filter, line, length, filter_record, job, NULL);
+  } else if (!blank_line(line, length)) {
+    process_document(job, line, length, job->lines);
   }
-
-  next_token(&parser->lexer); // Consume "}"
-  return 1;
+  print_job(job, lines->name, 0);
+  job->output.size = 0;
+  job->errors.size = 0;
 }
 
-int parse_array(json_parser *parser, Json_node *node)
+// NDJSON that isn't mapped is handled a line at a time as it's
+// decompressed, so only the line being processed is held in memory
+int process_lines(const Cli_options *options, const char *name, int fd, Json_stats *stats)
 {
-  if (!vector_new(&node->array, sizeof(Json_node), 1)) {
+  Json_stream stream;
+  Cli_lines lines = {.job = {.options = options, .ok = 1}, .name = name};
+
+  if (!json_stream_open_fd(&stream, fd)) {
     return 0;
   }
-  node->type = JSON_NODE_ARRAY;
+  vector_new(&lines.job.output, 1, 4096);
+  vector_new(&lines.job.errors, sizeof(Cli_error), 1);
 
-  while (peek_token(&parser->lexer).type != JSON_TOKEN_SQUARE_RBRACE)
-  {
-    Json_node value = {0};
-    if (!parse(parser, &value)) {
-      printf("ERROR! Couldn't parse\n");
-      return 0;
-    }
+  int ok = json_stream_lines(&stream, process_line, &lines);
+  ok &= json_stream_close(&stream);
+  if (!ok) {
+    fprintf(stderr, "ERROR! Couldn't read the whole input\n");
+  }
+  stats_merge(stats, &lines.job.stats);
+  vector_deallocate(&lines.job.output);
+  vector_deallocate(&lines.job.errors);
+  return ok && lines.job.ok;
+}
 
-    vector_push_back(&node->array, &value);
-    Json_token peek = peek_token(&parser->lexer);
-    if (peek.type == JSON_TOKEN_SQUARE_RBRACE) {
-      break;
-    } else if (peek.type == JSON_TOKEN_COMMA) {
-      next_token(&parser->lexer); // Consume ","
-    } else {
-      printf("ERROR! Expected token \",\" or \"]\" but got %s\n", json_token_type_to_string(peek.type));
-      print_token(&peek);
-      return 0;
+const char *column_type_name(JSON_COLUMN_TYPE type)
+{
+  switch (type) {
+    case JSON_COLUMN_NULL:
+      return "null";
+    case JSON_COLUMN_BOOLEAN:
+      return "boolean";
+    case JSON_COLUMN_INT64:
+      return "int64";
+    case JSON_COLUMN_DOUBLE:
+      return "double";
+    case JSON_COLUMN_STRING:
+      return "string";
+  }
+  return NULL;
+}
+
+void print_column(const Json_column *column)
+{
+  size_t nulls = 0;
+  for (size_t row = 0; row < column->length; row++) {
+    nulls += json_column_is_null(column, row);
+  }
+  printf("%-24s %-8s rows %zu nulls %zu mismatches %zu", column->name, column_type_name(column->type),
+         column->length, nulls, column->mismatches);
+
+  // Null rows hold zeros, so sums need no per-row checks
+  if (column->type == JSON_COLUMN_DOUBLE) {
+    double sum = 0;
+    for (size_t row = 0; row < column->doubles.size; row++) {
+      sum += column->doubles.items[row];
+    }
+    printf(" sum %.17g", sum);
+  } else if (column->type == JSON_COLUMN_INT64) {
+    int64_t sum = 0;
+    for (size_t row = 0; row < column->ints.size; row++) {
+      sum += column->ints.items[row];
     }
+    printf(" sum %lld", (long long)sum);
+  } else if (column->type == JSON_COLUMN_BOOLEAN) {
+    size_t count = 0;
+    for (size_t row = 0; row < column->bools.size; row++) {
+      count += column->bools.items[row];
+    }
+    printf(" true %zu", count);
+  } else if (column->type == JSON_COLUMN_STRING) {
+    printf(" bytes %zu", column->blob.size);
   }
+  printf("\n");
+}
 
-  next_token(&parser->lexer); // Consume "]"
-  return 1;
+int process_columns(const Cli_options *options, const char *name, Cli_input *input)
+{
+  Json_columns columns;
+  const char **keys = options->keys.size ? (const char **)options->keys.items : NULL;
+
+  int ok = json_columns_extract(input->data, input->length, keys, options->keys.size,
+                                (size_t)options->threads, &columns);
+  if (ok) {
+    printf("%s: %zu records\n", name, columns.rows);
+    for (size_t i = 0; i < columns.columns.size; i++) {
+      print_column(&columns.columns.items[i]);
+    }
+  } else {
+    fprintf(stderr, "%s: couldn't extract columns\n", name);
+  }
+  json_columns_deallocate(&columns);
+  return ok;
 }
 
-int parse(json_parser *parser, Json_node *node)
+void follow_record(const char *line, size_t length, size_t line_number, size_t offset, Json_object *obj,
+                   const Json_error *error, void *user_data)
 {
-  Json_token token = next_token(&parser->lexer);
-  switch (token.type) {
-    case JSON_TOKEN_CURLY_LBRACE:
-      {
-        if (!parse_object(parser, node)) {
-          return 0;
-        }
-      }
-      break;
-    case JSON_TOKEN_SQUARE_LBRACE:
-      {
-        if (!parse_array(parser, node)) {
-          return 0;
-        }
-      }
-      break;
-    case JSON_TOKEN_STRING:
-      {
-        node->type = JSON_NODE_STRING;
-        if (!slice_to_owned(token.literal, &node->string_value)) {
-          printf("ERROR! Couldn't allocate memory for string\n");
-          return 0;
-        }
-      }
-      break;
-    case JSON_TOKEN_NUMBER:
-      {
-        node->type = JSON_NODE_NUMBER;
-        char *string_number;
-        if (!slice_to_owned(token.literal, &string_number)) {
-          printf("ERROR! Couldn't allocate memory for string\n");
-          return 0;
-        }
-        node->number_value = atof(string_number);
-        free(string_number);
-      }
-      break;
-    case JSON_TOKEN_BOOLEAN:
-      {
-        node->type = JSON_NODE_BOOLEAN;
-        node->bool_value = slice_equals(token.literal, _slice("true"));
-      }
-      break;
-    case JSON_TOKEN_NULL:
-      {
-        node->type = JSON_NODE_NULL;
-      }
-      break;
-    case JSON_TOKEN_EOF:
-      {
-        return 1;
-      }
-    default:
-      {
-        printf("ERROR! Unexpected token while parsing\n");
-        print_token(&token);
-        return 0;
-      }
-      break;
+  Cli_follow *follow = (Cli_follow *)user_data;
+  (void)line;
+  (void)length;
+  (void)offset;
+
+  if (error) {
+    fprintf(stderr, "%s:%zu:%zu: %s\n", follow->name, line_number + error->line - 1, error->column, error->message);
+    follow->ok = 0;
+    return;
+  }
+  if (!json_write(&follow->output, &obj->root) || !vector_append(&follow->output, "\n", 1)) {
+    follow->ok = 0;
   }
-  return 1;
 }
 
-int json_parse(json_parser *parser, const char *file_path, Json_object *obj)
+void follow_flush(void *user_data)
 {
-  if (!json_load_file(&parser->lexer, file_path))
-  {
+  Cli_follow *follow = (Cli_follow *)user_data;
+  fwrite(follow->output.items, 1, follow->output.size, stdout);
+  fflush(stdout);
+  follow->output.size = 0;
+}
+
+void cli_interrupt(int signal)
+{
+  (void)signal;
+  cli_stop = 1;
+}
+
+int process_follow(const Cli_options *options, const char *path)
+{
+  Json_follower follower;
+  Cli_follow follow = {.name = path, .ok = 1};
+
+  if (strcmp(path, "-") == 0) {
+    fprintf(stderr, "ERROR! follow needs a file\n");
     return 0;
   }
-
-  if (!parse(parser, &obj->root)) {
+  if (!vector_new(&follow.output, 1, 4096)) {
+    return 0;
+  }
+  // Numbers are echoed as written
+  if (!json_follow_open(&follower, path, options->checkpoint, JSON_PARSE_LAZY_NUMBERS)) {
+    vector_deallocate(&follow.output);
     return 0;
   }
 
-  free(parser->lexer.content);
-  return 1;
+  struct sigaction action = {0};
+  action.sa_handler = cli_interrupt;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  int ok = json_follow_run(&follower, follow_record, follow_flush, &follow, &cli_stop);
+  follow_flush(&follow);
+
+  json_follow_close(&follower);
+  vector_deallocate(&follow.output);
+  return ok && follow.ok;
 }
 
-void json_free(Json_node *node) 
+void print_stats(const Json_stats *stats)
 {
-  switch (node->type) {
-    case JSON_NODE_ARRAY:
-      {
-        for (size_t i = 0; i < node->array.size; i++) {
-          json_free(vector_get_ref_at(&node->array, i));
-        }
-        vector_deallocate(&node->array);
-      }
-      break;
-    case JSON_NODE_STRING:
-      {
-        free(node->string_value);
-      }
-      break;
-    case JSON_NODE_OBJECT:
-      {
-        for (size_t i = 0; i < BUCKETS_SIZE; i++) {
-          if (!node->map.buckets[i]) {
-            continue;
-          } else {
-            HashMapEntry *entry = node->map.buckets[i];
-            while (entry) {
-              HashMapEntry *temp = entry;
-              entry = entry->next;
-              Json_node *value = (Json_node *)temp->value;
-              free(temp->key);
-              json_free(value);
-              free(value);
-            }
-          }
-        }
-        hashmap_deallocate(&node->map);
-      }
-      break;
-    default:
-      break;
-  }
+  printf("documents: %zu\n", stats->documents);
+  printf("bytes:     %zu\n", stats->bytes);
+  printf("objects:   %zu\n", stats->objects);
+  printf("arrays:    %zu\n", stats->arrays);
+  printf("keys:      %zu\n", stats->keys);
+  printf("strings:   %zu\n", stats->strings);
+  printf("numbers:   %zu\n", stats->numbers);
+  printf("booleans:  %zu\n", stats->booleans);
+  printf("nulls:     %zu\n", stats->nulls);
+  printf("max depth: %zu\n", stats->max_depth);
 }
 
-void json_unload(Json_object *obj)
+// Parses "<key>=<value>" in place, returning the value
+char *split_predicate(char *arg)
 {
-  json_free(&obj->root);
+  char *value = strchr(arg, '=');
+  if (!value) {
+    fprintf(stderr, "ERROR! Expected <key>=<value>, got \"%s\"\n", arg);
+    return NULL;
+  }
+  *value = '\0';
+  return value + 1;
 }
 
-int json_search_key(Json_node* root, char* key, Json_node** value)
+int add_predicate(Json_filter *filter, const char *option, char *arg)
 {
-  if (!root || !key || !*key || !value) {
-    fprintf(stderr, "Error! Some parameter are missing\n");
+  if (strcmp(option, "--has") == 0) {
+    return json_filter_add_exists(filter, arg);
+  }
+
+  char *value = split_predicate(arg);
+  if (!value) {
     return 0;
   }
+  if (strcmp(option, "--eq") == 0) {
+    return json_filter_add_equals_string(filter, arg, value);
+  } else if (strcmp(option, "--num") == 0) {
+    return json_filter_add_equals_number(filter, arg, strtod(value, NULL));
+  }
 
-  *value = (Json_node*)hashmap_search(&root->map, key);
-  if (*value == NULL) {
-    fprintf(stderr, "ERROR! key \"%s\" doesn't exist\n", key);
+  char *max = strchr(value, ':');
+  if (!max) {
+    fprintf(stderr, "ERROR! Expected <min>:<max>, got \"%s\"\n", value);
     return 0;
   }
-  return 1;
+  return json_filter_add_range(filter, arg, strtod(value, NULL), strtod(max + 1, NULL));
 }
 
-void json_print_value(Json_node* value)
+int main(int argc, char **argv)
 {
-  switch (value->type) {
-    case JSON_NODE_STRING: {
-      printf("%s", value->string_value);
+  Cli_options options = {.threads = 1};
+  Vector files;
+  int i = 1;
+
+  if (argc < 2) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  const char *command = argv[i++];
+  if (strcmp(command, "validate") == 0) {
+    options.command = CLI_VALIDATE;
+  } else if (strcmp(command, "minify") == 0) {
+    options.command = CLI_MINIFY;
+  } else if (strcmp(command, "pretty") == 0) {
+    options.command = CLI_PRETTY;
+  } else if (strcmp(command, "stats") == 0) {
+    options.command = CLI_STATS;
+  } else if (strcmp(command, "columns") == 0) {
+    options.command = CLI_COLUMNS;
+  } else if (strcmp(command, "follow") == 0) {
+    options.command = CLI_FOLLOW;
+  } else if (strcmp(command, "filter") == 0) {
+    options.command = CLI_FILTER;
+    options.ndjson = 1;
+  } else if (strcmp(command, "query") == 0 && i < argc) {
+    options.command = CLI_QUERY;
+    options.path = argv[i++];
+  } else {
+    usage(argv[0]);
+    return 2;
+  }
+
+  json_filter_new(&options.filter);
+  if (!vector_new(&files, sizeof(char *), 1) || !vector_new(&options.keys, sizeof(char *), 1)) {
+    return 1;
+  }
+  for (; i < argc; i++) {
+    if (strcmp(argv[i], "--ndjson") == 0) {
+      options.ndjson = 1;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.threads = atoi(argv[++i]);
+      if (options.threads < 1 || options.threads > CLI_MAX_THREADS) {
+        fprintf(stderr, "ERROR! --threads must be between 1 and %d\n", CLI_MAX_THREADS);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+      for (char *key = strtok(argv[++i], ","); key; key = strtok(NULL, ",")) {
+        vector_push_back(&options.keys, &key);
+      }
+    } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+      options.checkpoint = argv[++i];
+    } else if (options.command == CLI_FILTER && i + 1 < argc &&
+               (strcmp(argv[i], "--has") == 0 || strcmp(argv[i], "--eq") == 0 ||
+                strcmp(argv[i], "--num") == 0 || strcmp(argv[i], "--range") == 0)) {
+      if (!add_predicate(&options.filter, argv[i], argv[i + 1])) {
+        return 2;
+      }
+      i++;
+    } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else {
+      vector_push_back(&files, &argv[i]);
     }
-    break; 
-    case JSON_NODE_BOOLEAN: {
-      printf("%s", value->bool_value ? "true" : "false");
+  }
+  if (options.command == CLI_FOLLOW && files.size != 1) {
+    fprintf(stderr, "ERROR! follow takes exactly one file\n");
+    return 2;
+  }
+  if (files.size == 0) {
+    char *stdin_path = "-";
+    vector_push_back(&files, &stdin_path);
+  }
+
+  int ok = 1;
+  Json_stats stats = {0};
+  for (size_t f = 0; f < files.size; f++) {
+    const char *path = *(char **)vector_get_ref_at(&files, f);
+    Cli_input input;
+    int fd;
+    if (options.command == CLI_FOLLOW) {
+      ok &= process_follow(&options, path);
+      continue;
     }
-    break;
-    case JSON_NODE_NULL: {
-      printf("NULL");
+    if (!open_input(path, &input, &fd)) {
+      ok = 0;
+      continue;
     }
-    break;
-    case JSON_NODE_NUMBER: {
-      printf("%2.f\n", value->number_value);
+    if (!input.mapped && options.ndjson && options.command != CLI_COLUMNS) {
+      ok &= process_lines(&options, path, fd, &stats);
+      continue;
     }
-    break;
-    case JSON_NODE_ARRAY: {
-      for (size_t i = 0; i < value->array.size; i++) {
-        Json_node *n = vector_get_ref_at(&value->array, i);
-        json_print_value(n);
-        if (i != vector_get_size(&value->array) - 1) {
-          printf(" ");
-        }
-      }
+    if (!input.mapped && !read_stream(fd, &input)) {
+      ok = 0;
+      continue;
     }
-    break;
-    case JSON_NODE_OBJECT: {
-        for (size_t i = 0; i < BUCKETS_SIZE; i++) {
-          if (!value->map.buckets[i]) {
-            continue;
-          } else {
-            HashMapEntry *entry = value->map.buckets[i];
-            while (entry) {
-              HashMapEntry *temp = entry;
-              entry = entry->next;
-              Json_node *value = (Json_node *)temp->value;
-              printf("key: \"%s\" ", (char*)temp->key);
-              printf("value: \"");
-              json_print_value(value);
-              printf("\"");
-              printf("\n");
-            }
-          }
-        }
-      }
-    break;
-  }
-}
-
-int main()
-{
-  json_parser parser = {0};
-  Json_object object = {0};
-  Json_node* node;
-  if (!json_parse(&parser, "example2.json", &object)) {
-    return 1;
+    if (options.command == CLI_COLUMNS) {
+      ok &= process_columns(&options, path, &input);
+    } else {
+      ok &= process_input(&options, path, &input, &stats);
+    }
+    release_input(&input);
   }
 
-  if (!json_search_key(&object.root, "work", &node)) {
-    return 1;
+  if (options.command == CLI_STATS) {
+    print_stats(&stats);
   }
-  json_print_value(node);
-  printf("\n");
-  json_unload(&object);
-  return 0;
-}
\ No newline at end of file
+  json_filter_deallocate(&options.filter);
+  vector_deallocate(&options.keys);
+  vector_deallocate(&files);
+  return ok ? 0 : 1;
+}
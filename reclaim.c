@@ -0,0 +1,256 @@
+#include "reclaim.h"
+
+#include <stdatomic.h>
+
+// json_unload_deferred moves the document into a heap item and queues it,
+// so the caller only pays for one small allocation. Reclaimer threads free
+// the tree. Large trees are split: the root object's bucket chains and the
+// ranges of long arrays are requeued so several threads can free them.
+
+typedef enum {
+  JSON_RECLAIM_DOCUMENT,
+  JSON_RECLAIM_ENTRIES,
+  JSON_RECLAIM_RANGE
+} JSON_RECLAIM_KIND;
+
+// An array buffer shared by the ranges freeing its elements
+typedef struct Json_reclaim_block {
+  Json_node *items;
+  atomic_size_t ranges;
+} Json_reclaim_block;
+
+typedef struct Json_reclaim_item {
+  JSON_RECLAIM_KIND kind;
+  Json_object object;          // JSON_RECLAIM_DOCUMENT
+  Json_node_mapEntry *entries; // JSON_RECLAIM_ENTRIES, one bucket chain
+  Json_reclaim_block *block;   // JSON_RECLAIM_RANGE
+  size_t begin;
+  size_t end;
+} Json_reclaim_item;
+
+void reclaim_item(Json_reclaimer *reclaimer, Json_reclaim_item *item);
+void reclaim_range(Json_reclaimer *reclaimer, Json_reclaim_block *block, size_t begin, size_t end);
+
+void reclaim_done(Json_reclaimer *reclaimer, size_t count)
+{
+  pthread_mutex_lock(&reclaimer->lock);
+  reclaimer->pending -= count;
+  if (reclaimer->pending == 0) {
+    pthread_cond_broadcast(&reclaimer->idle);
+  }
+  pthread_mutex_unlock(&reclaimer->lock);
+}
+
+// Hands an item to another thread, or frees it here when the queue is full
+void reclaim_spawn(Json_reclaimer *reclaimer, Json_reclaim_item *item)
+{
+  pthread_mutex_lock(&reclaimer->lock);
+  reclaimer->pending++;
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  if (!queue_try_push(&reclaimer->queue, item)) {
+    reclaim_item(reclaimer, item);
+    reclaim_done(reclaimer, 1);
+  }
+}
+
+void reclaim_node(Json_reclaimer *reclaimer, Json_node *node)
+{
+  if (node->type != JSON_NODE_ARRAY || (node->flags & JSON_NODE_FLAG_PACKED) ||
+      node->array.size < JSON_RECLAIM_SPLIT || reclaimer->thread_count < 2) {
+    json_free(node);
+    return;
+  }
+
+  Json_reclaim_block *block = (Json_reclaim_block *)malloc(sizeof(Json_reclaim_block));
+  if (!block) {
+    json_free(node);
+    return;
+  }
+
+  size_t size = node->array.size;
+  size_t ranges = (size + JSON_RECLAIM_SPLIT - 1) / JSON_RECLAIM_SPLIT;
+  block->items = node->array.items;
+  atomic_init(&block->ranges, ranges);
+  node->array.items = NULL;
+  node->array.size = 0;
+  node->array.capacity = 0;
+
+  for (size_t begin = 0; begin < size; begin += JSON_RECLAIM_SPLIT) {
+    size_t end = begin + JSON_RECLAIM_SPLIT < size ? begin + JSON_RECLAIM_SPLIT : size;
+    Json_reclaim_item *item = (Json_reclaim_item *)malloc(sizeof(Json_reclaim_item));
+    if (!item) {
+      reclaim_range(reclaimer, block, begin, end);
+      continue;
+    }
+    item->kind = JSON_RECLAIM_RANGE;
+    item->block = block;
+    item->begin = begin;
+    item->end = end;
+    reclaim_spawn(reclaimer, item);
+  }
+}
+
+void reclaim_entries(Json_reclaimer *reclaimer, Json_node_mapEntry *entry)
+{
+  while (entry) {
+    Json_node_mapEntry *next = entry->next;
+    free(entry->key);
+    reclaim_node(reclaimer, &entry->value);
+    free(entry);
+    entry = next;
+  }
+}
+
+void reclaim_document(Json_reclaimer *reclaimer, Json_object *obj)
+{
+  Json_node *root = &obj->root;
+
+  if (root->type == JSON_NODE_OBJECT && reclaimer->thread_count > 1) {
+    for (size_t i = 0; i < BUCKETS_SIZE; i++) {
+      if (!root->map.buckets[i]) {
+        continue;
+      }
+      Json_reclaim_item *item = (Json_reclaim_item *)malloc(sizeof(Json_reclaim_item));
+      if (!item) {
+        continue; // Left in the map, freed by json_unload below
+      }
+      item->kind = JSON_RECLAIM_ENTRIES;
+      item->entries = root->map.buckets[i];
+      root->map.buckets[i] = NULL;
+      reclaim_spawn(reclaimer, item);
+    }
+  } else if (root->type == JSON_NODE_ARRAY) {
+    reclaim_node(reclaimer, root);
+  }
+  json_unload(obj);
+}
+
+void reclaim_range(Json_reclaimer *reclaimer, Json_reclaim_block *block, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; i++) {
+    reclaim_node(reclaimer, &block->items[i]);
+  }
+  if (atomic_fetch_sub(&block->ranges, 1) == 1) {
+    free(block->items);
+    free(block);
+  }
+}
+
+void reclaim_item(Json_reclaimer *reclaimer, Json_reclaim_item *item)
+{
+  switch (item->kind) {
+    case JSON_RECLAIM_DOCUMENT:
+      reclaim_document(reclaimer, &item->object);
+      break;
+    case JSON_RECLAIM_ENTRIES:
+      reclaim_entries(reclaimer, item->entries);
+      break;
+    case JSON_RECLAIM_RANGE:
+      reclaim_range(reclaimer, item->block, item->begin, item->end);
+      break;
+  }
+  free(item);
+}
+
+void *reclaimer_thread(void *arg)
+{
+  Json_reclaimer *reclaimer = (Json_reclaimer *)arg;
+  void *batch[JSON_RECLAIM_BATCH];
+
+  while (queue_pop(&reclaimer->queue, &batch[0])) {
+    size_t count = 1;
+    while (count < JSON_RECLAIM_BATCH && queue_try_pop(&reclaimer->queue, &batch[count])) {
+      count++;
+    }
+    for (size_t i = 0; i < count; i++) {
+      reclaim_item(reclaimer, (Json_reclaim_item *)batch[i]);
+    }
+    reclaim_done(reclaimer, count);
+  }
+  return NULL;
+}
+
+int json_reclaimer_start(Json_reclaimer *reclaimer, size_t threads, size_t queue_capacity)
+{
+  if (threads == 0 || queue_capacity == 0) {
+    fprintf(stderr, "ERROR! A reclaimer needs at least one thread and one queue slot\n");
+    return 0;
+  }
+  if (!queue_new(&reclaimer->queue, queue_capacity)) {
+    return 0;
+  }
+  reclaimer->threads = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  if (!reclaimer->threads) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for reclaimer threads\n");
+    queue_deallocate(&reclaimer->queue);
+    return 0;
+  }
+  reclaimer->thread_count = 0;
+  reclaimer->pending = 0;
+  pthread_mutex_init(&reclaimer->lock, NULL);
+  pthread_cond_init(&reclaimer->idle, NULL);
+
+  for (size_t i = 0; i < threads; i++) {
+    if (pthread_create(&reclaimer->threads[reclaimer->thread_count], NULL, reclaimer_thread, reclaimer) == 0) {
+      reclaimer->thread_count++;
+    }
+  }
+  if (reclaimer->thread_count == 0) {
+    fprintf(stderr, "ERROR! Couldn't start reclaimer threads\n");
+    json_reclaimer_stop(reclaimer);
+    return 0;
+  }
+  return 1;
+}
+
+// Moves the document to the reclaimer and leaves obj empty. Returns without
+// walking the tree; it only waits when the queue is full. Falls back to a
+// synchronous json_unload if the document can't be queued.
+int json_unload_deferred(Json_reclaimer *reclaimer, Json_object *obj)
+{
+  Json_reclaim_item *item = (Json_reclaim_item *)malloc(sizeof(Json_reclaim_item));
+  if (!item) {
+    json_unload(obj);
+    return 0;
+  }
+  item->kind = JSON_RECLAIM_DOCUMENT;
+  item->object = *obj;
+  memset(obj, 0, sizeof(*obj));
+
+  pthread_mutex_lock(&reclaimer->lock);
+  reclaimer->pending++;
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  if (!queue_push(&reclaimer->queue, item)) {
+    reclaim_item(reclaimer, item);
+    reclaim_done(reclaimer, 1);
+    return 0;
+  }
+  return 1;
+}
+
+// Waits until every document handed over so far has been freed
+void json_reclaimer_flush(Json_reclaimer *reclaimer)
+{
+  pthread_mutex_lock(&reclaimer->lock);
+  while (reclaimer->pending > 0) {
+    pthread_cond_wait(&reclaimer->idle, &reclaimer->lock);
+  }
+  pthread_mutex_unlock(&reclaimer->lock);
+}
+
+void json_reclaimer_stop(Json_reclaimer *reclaimer)
+{
+  json_reclaimer_flush(reclaimer);
+  queue_close(&reclaimer->queue);
+  for (size_t i = 0; i < reclaimer->thread_count; i++) {
+    pthread_join(reclaimer->threads[i], NULL);
+  }
+  free(reclaimer->threads);
+  reclaimer->threads = NULL;
+  reclaimer->thread_count = 0;
+  queue_deallocate(&reclaimer->queue);
+  pthread_mutex_destroy(&reclaimer->lock);
+  pthread_cond_destroy(&reclaimer->idle);
+}
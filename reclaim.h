@@ -0,0 +1,24 @@
+#ifndef __RECLAIM__
+#define __RECLAIM__
+
+#include "json.h"
+
+#define JSON_RECLAIM_BATCH 32  // Items a reclaimer thread takes per wakeup
+#define JSON_RECLAIM_SPLIT 4096 // Arrays this long are freed in parallel ranges
+
+// Background threads that free documents handed over by json_unload_deferred
+typedef struct Json_reclaimer {
+  Queue queue;
+  pthread_t *threads;
+  size_t thread_count;
+  size_t pending; // Items queued or being freed
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+} Json_reclaimer;
+
+int json_reclaimer_start(Json_reclaimer *reclaimer, size_t threads, size_t queue_capacity);
+int json_unload_deferred(Json_reclaimer *reclaimer, Json_object *obj);
+void json_reclaimer_flush(Json_reclaimer *reclaimer);
+void json_reclaimer_stop(Json_reclaimer *reclaimer);
+
+#endif // __RECLAIM__
@@ -0,0 +1,471 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef JSON_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JSON_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define STREAM_INPUT_BLOCK (1 << 16)
+
+// One thread reads and decompresses the file into fixed-size chunks and
+// pushes them into a bounded queue; the consumer pops them in order. When
+// the consumer falls behind the queue fills up and decompression waits, so
+// memory stays at JSON_STREAM_QUEUE chunks plus whatever the consumer keeps.
+
+JSON_COMPRESSION json_detect_compression(const unsigned char *magic, size_t length)
+{
+  if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return JSON_COMPRESSION_GZIP;
+  }
+  if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+    return JSON_COMPRESSION_ZSTD;
+  }
+  return JSON_COMPRESSION_NONE;
+}
+
+// Reads from the file, replaying the bytes consumed by detection first
+ssize_t stream_read(Json_stream *stream, void *buf, size_t length)
+{
+  if (stream->magic_length > 0) {
+    size_t n = stream->magic_length < length ? stream->magic_length : length;
+    memcpy(buf, stream->magic, n);
+    memmove(stream->magic, stream->magic + n, stream->magic_length - n);
+    stream->magic_length -= n;
+    return (ssize_t)n;
+  }
+  for (;;) {
+    ssize_t n = read(stream->fd, buf, length);
+    if (n >= 0 || errno != EINTR) {
+      if (n < 0) {
+        perror("read");
+      }
+      return n;
+    }
+  }
+}
+
+Json_stream_chunk *stream_chunk_new(void)
+{
+  Json_stream_chunk *chunk = (Json_stream_chunk *)malloc(sizeof(Json_stream_chunk) + JSON_STREAM_CHUNK);
+  if (!chunk) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for stream chunk\n");
+    return NULL;
+  }
+  chunk->length = 0;
+  return chunk;
+}
+
+// Hands a full chunk over and starts the next one. Fails when the consumer
+// closed the stream early.
+int stream_push(Json_stream *stream, Json_stream_chunk **chunk)
+{
+  if (!queue_push(&stream->chunks, *chunk)) {
+    free(*chunk);
+    *chunk = NULL;
+    return 0;
+  }
+  *chunk = stream_chunk_new();
+  return *chunk != NULL;
+}
+
+int stream_copy(Json_stream *stream, Json_stream_chunk **chunk)
+{
+  for (;;) {
+    ssize_t n = stream_read(stream, (*chunk)->data + (*chunk)->length, JSON_STREAM_CHUNK - (*chunk)->length);
+    if (n < 0) {
+      return 0;
+    }
+    if (n == 0) {
+      return 1;
+    }
+    (*chunk)->length += (size_t)n;
+    if ((*chunk)->length == JSON_STREAM_CHUNK && !stream_push(stream, chunk)) {
+      return 0;
+    }
+  }
+}
+
+#ifdef JSON_HAVE_ZLIB
+// Concatenated members, as written by `gzip -c a b`, are decompressed one
+// after the other
+int stream_inflate(Json_stream *stream, Json_stream_chunk **chunk)
+{
+  unsigned char input[STREAM_INPUT_BLOCK];
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, 15 + 16) != Z_OK) {
+    fprintf(stderr, "ERROR! Couldn't initialize zlib\n");
+    return 0;
+  }
+
+  int ok = 1;
+  int done = 0;  // The last member ended
+  int flush = 0; // The output filled up, zlib may still hold bytes
+  for (;;) {
+    if (z.avail_in == 0 && !flush) {
+      ssize_t n = stream_read(stream, input, sizeof(input));
+      if (n <= 0) {
+        ok = n == 0;
+        break;
+      }
+      z.next_in = input;
+      z.avail_in = (uInt)n;
+    }
+    if (done && z.avail_in > 0) {
+      inflateReset(&z);
+      done = 0;
+    }
+
+    z.next_out = (Bytef *)(*chunk)->data + (*chunk)->length;
+    z.avail_out = (uInt)(JSON_STREAM_CHUNK - (*chunk)->length);
+    int ret = inflate(&z, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+      fprintf(stderr, "ERROR! Corrupt gzip input: %s\n", z.msg ? z.msg : "unknown error");
+      ok = 0;
+      break;
+    }
+    (*chunk)->length = JSON_STREAM_CHUNK - z.avail_out;
+    done = ret == Z_STREAM_END;
+    flush = !done && z.avail_out == 0;
+    if ((*chunk)->length == JSON_STREAM_CHUNK && !stream_push(stream, chunk)) {
+      ok = 0;
+      break;
+    }
+  }
+  if (ok && !done) {
+    fprintf(stderr, "ERROR! Truncated gzip input\n");
+    ok = 0;
+  }
+  inflateEnd(&z);
+  return ok;
+}
+#endif
+
+#ifdef JSON_HAVE_ZSTD
+int stream_unzstd(Json_stream *stream, Json_stream_chunk **chunk)
+{
+  unsigned char buffer[STREAM_INPUT_BLOCK];
+  ZSTD_DStream *zds = ZSTD_createDStream();
+  if (!zds) {
+    fprintf(stderr, "ERROR! Couldn't initialize zstd\n");
+    return 0;
+  }
+  ZSTD_initDStream(zds);
+
+  ZSTD_inBuffer input = {buffer, 0, 0};
+  int ok = 1;
+  size_t pending = 1; // 0 once a frame is fully decoded and flushed
+  int flush = 0;
+  for (;;) {
+    if (input.pos == input.size && !flush) {
+      ssize_t n = stream_read(stream, buffer, sizeof(buffer));
+      if (n <= 0) {
+        ok = n == 0;
+        break;
+      }
+      input.size = (size_t)n;
+      input.pos = 0;
+    }
+
+    ZSTD_outBuffer output = {(*chunk)->data, JSON_STREAM_CHUNK, (*chunk)->length};
+    pending = ZSTD_decompressStream(zds, &output, &input);
+    if (ZSTD_isError(pending)) {
+      fprintf(stderr, "ERROR! Corrupt zstd input: %s\n", ZSTD_getErrorName(pending));
+      ok = 0;
+      break;
+    }
+    (*chunk)->length = output.pos;
+    flush = output.pos == output.size;
+    if ((*chunk)->length == JSON_STREAM_CHUNK && !stream_push(stream, chunk)) {
+      ok = 0;
+      break;
+    }
+  }
+  if (ok && pending != 0) {
+    fprintf(stderr, "ERROR! Truncated zstd input\n");
+    ok = 0;
+  }
+  ZSTD_freeDStream(zds);
+  return ok;
+}
+#endif
+
+void *stream_thread(void *arg)
+{
+  Json_stream *stream = (Json_stream *)arg;
+  Json_stream_chunk *chunk = stream_chunk_new();
+  int ok = chunk != NULL;
+
+  if (ok) {
+    switch (stream->compression) {
+      case JSON_COMPRESSION_NONE:
+        ok = stream_copy(stream, &chunk);
+        break;
+#ifdef JSON_HAVE_ZLIB
+      case JSON_COMPRESSION_GZIP:
+        ok = stream_inflate(stream, &chunk);
+        break;
+#endif
+#ifdef JSON_HAVE_ZSTD
+      case JSON_COMPRESSION_ZSTD:
+        ok = stream_unzstd(stream, &chunk);
+        break;
+#endif
+      default:
+        ok = 0;
+        break;
+    }
+  }
+  if (chunk && chunk->length > 0 && ok) {
+    ok = queue_push(&stream->chunks, chunk);
+    chunk = ok ? NULL : chunk;
+  }
+  free(chunk);
+
+  stream->failed = !ok; // Published to the consumer by queue_close
+  queue_close(&stream->chunks);
+  return NULL;
+}
+
+int json_stream_open(Json_stream *stream, const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR! can't open file %s\n", path);
+    return 0;
+  }
+  return json_stream_open_fd(stream, fd);
+}
+
+// Takes ownership of fd, which can be a pipe: detection reads the first
+// bytes instead of seeking back
+int json_stream_open_fd(Json_stream *stream, int fd)
+{
+  memset(stream, 0, sizeof(*stream));
+  stream->fd = fd;
+
+  while (stream->magic_length < sizeof(stream->magic)) {
+    ssize_t n = read(fd, stream->magic + stream->magic_length, sizeof(stream->magic) - stream->magic_length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      perror("read");
+      close(fd);
+      return 0;
+    }
+    if (n == 0) {
+      break;
+    }
+    stream->magic_length += (size_t)n;
+  }
+
+  stream->compression = json_detect_compression(stream->magic, stream->magic_length);
+#ifndef JSON_HAVE_ZLIB
+  if (stream->compression == JSON_COMPRESSION_GZIP) {
+    fprintf(stderr, "ERROR! Input is gzip compressed, but zlib support wasn't built in\n");
+    close(fd);
+    return 0;
+  }
+#endif
+#ifndef JSON_HAVE_ZSTD
+  if (stream->compression == JSON_COMPRESSION_ZSTD) {
+    fprintf(stderr, "ERROR! Input is zstd compressed, but zstd support wasn't built in\n");
+    close(fd);
+    return 0;
+  }
+#endif
+
+  if (!queue_new(&stream->chunks, JSON_STREAM_QUEUE)) {
+    close(fd);
+    return 0;
+  }
+  if (pthread_create(&stream->thread, NULL, stream_thread, stream) != 0) {
+    fprintf(stderr, "ERROR! Couldn't start decompression thread\n");
+    queue_deallocate(&stream->chunks);
+    close(fd);
+    return 0;
+  }
+  stream->started = 1;
+  return 1;
+}
+
+// Pops the next chunk in file order, which the caller frees. Fails at the
+// end of the input; json_stream_close then tells whether it was complete.
+int json_stream_next(Json_stream *stream, Json_stream_chunk **chunk)
+{
+  void *item;
+  if (!queue_pop(&stream->chunks, &item)) {
+    return 0;
+  }
+  *chunk = (Json_stream_chunk *)item;
+  return 1;
+}
+
+// Splits the decompressed input into lines as chunks arrive. Lines are
+// passed straight out of the chunk, only those crossing a chunk boundary
+// are copied. Returns 0 when the input couldn't be read completely.
+int json_stream_lines(Json_stream *stream, Json_stream_line_callback callback, void *user_data)
+{
+  Vector carry; // char, a line started in an earlier chunk
+  size_t carry_offset = 0;
+  size_t chunk_offset = 0;
+  Json_stream_chunk *chunk;
+  int ok = 1;
+
+  if (!vector_new(&carry, 1, 4096)) {
+    return 0;
+  }
+  while (ok && json_stream_next(stream, &chunk)) {
+    const char *p = chunk->data;
+    const char *end = chunk->data + chunk->length;
+
+    if (carry.size > 0) {
+      const char *newline = memchr(p, '\n', end - p);
+      const char *stop = newline ? newline : end;
+      ok = vector_append(&carry, (void *)p, stop - p);
+      if (ok && newline) {
+        size_t length = carry.size;
+        if (length > 0 && ((char *)carry.items)[length - 1] == '\r') {
+          length--;
+        }
+        callback((char *)carry.items, length, carry_offset, user_data);
+        carry.size = 0;
+      }
+      p = newline ? newline + 1 : end;
+    }
+
+    const char *newline;
+    while (ok && (newline = memchr(p, '\n', end - p))) {
+      size_t length = newline - p;
+      if (length > 0 && p[length - 1] == '\r') {
+        length--;
+      }
+      callback(p, length, chunk_offset + (p - chunk->data), user_data);
+      p = newline + 1;
+    }
+    if (ok && p < end) {
+      if (carry.size == 0) {
+        carry_offset = chunk_offset + (p - chunk->data);
+      }
+      ok = vector_append(&carry, (void *)p, end - p);
+    }
+    chunk_offset += chunk->length;
+    free(chunk);
+  }
+
+  if (ok && carry.size > 0) {
+    callback((char *)carry.items, carry.size, carry_offset, user_data);
+  }
+  vector_deallocate(&carry);
+  return ok && !stream->failed;
+}
+
+// Collects the whole decompressed input into one NUL-terminated buffer
+int json_stream_read_all(Json_stream *stream, char **data, size_t *length)
+{
+  size_t capacity = JSON_STREAM_CHUNK;
+  size_t size = 0;
+  char *buffer = (char *)malloc(capacity + 1);
+  Json_stream_chunk *chunk;
+
+  if (!buffer) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for input\n");
+    return 0;
+  }
+  while (json_stream_next(stream, &chunk)) {
+    if (size + chunk->length > capacity) {
+      while (size + chunk->length > capacity) {
+        capacity *= 2;
+      }
+      char *grown = (char *)realloc(buffer, capacity + 1);
+      if (!grown) {
+        fprintf(stderr, "ERROR! Couldn't allocate memory for input\n");
+        free(chunk);
+        free(buffer);
+        return 0;
+      }
+      buffer = grown;
+    }
+    memcpy(buffer + size, chunk->data, chunk->length);
+    size += chunk->length;
+    free(chunk);
+  }
+  if (stream->failed) {
+    free(buffer);
+    return 0;
+  }
+  buffer[size] = '\0';
+  *data = buffer;
+  *length = size;
+  return 1;
+}
+
+int stream_refill(Json_source *source)
+{
+  Json_stream *stream = (Json_stream *)source; // source is the first member
+  Json_stream_chunk *chunk;
+
+  if (!json_stream_next(stream, &chunk)) {
+    return 0;
+  }
+  if (source->length + chunk->length > stream->capacity) {
+    size_t capacity = stream->capacity ? stream->capacity : JSON_STREAM_CHUNK;
+    while (source->length + chunk->length > capacity) {
+      capacity *= 2;
+    }
+    char *grown = (char *)realloc(source->data, capacity);
+    if (!grown) {
+      fprintf(stderr, "ERROR! Couldn't allocate memory for input\n");
+      free(chunk);
+      return 0;
+    }
+    source->data = grown;
+    stream->capacity = capacity;
+  }
+  memcpy(source->data + source->length, chunk->data, chunk->length);
+  source->length += chunk->length;
+  free(chunk);
+  return 1;
+}
+
+// Parses a single document while the rest of it is still being
+// decompressed. The text read so far stays buffered until the stream is
+// closed, since the lexer addresses it by absolute position. A failure
+// after the end of the document only shows in json_stream_close.
+int json_parse_stream(json_parser *parser, Json_stream *stream, Json_object *obj)
+{
+  stream->source.refill = stream_refill;
+  return json_parse_source(parser, &stream->source, obj);
+}
+
+// Stops decompression if the consumer quit early. Returns 0 when the input
+// couldn't be read or decompressed completely.
+int json_stream_close(Json_stream *stream)
+{
+  void *item;
+
+  if (!stream->started) {
+    return 0;
+  }
+  queue_close(&stream->chunks);
+  pthread_join(stream->thread, NULL);
+  while (queue_pop(&stream->chunks, &item)) {
+    free(item);
+  }
+  queue_deallocate(&stream->chunks);
+  close(stream->fd);
+  free(stream->source.data);
+  stream->source.data = NULL;
+  stream->source.length = 0;
+  stream->started = 0;
+  return !stream->failed;
+}
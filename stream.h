@@ -0,0 +1,49 @@
+#ifndef __STREAM__
+#define __STREAM__
+
+#include "json.h"
+
+#define JSON_STREAM_CHUNK (1 << 18) // Decompressed bytes per chunk
+#define JSON_STREAM_QUEUE 8         // Chunks decompressed ahead of the parser
+
+typedef enum {
+  JSON_COMPRESSION_NONE,
+  JSON_COMPRESSION_GZIP,
+  JSON_COMPRESSION_ZSTD
+} JSON_COMPRESSION;
+
+typedef struct Json_stream_chunk {
+  size_t length;
+  char data[];
+} Json_stream_chunk;
+
+// Called once per line, blank lines included, without the newline. offset
+// is the position of the line in the decompressed input.
+typedef void (*Json_stream_line_callback)(const char *line, size_t length, size_t offset, void *user_data);
+
+// A file decompressed on a background thread into a bounded queue of
+// chunks, so decompression overlaps with whatever consumes them. The
+// compression is detected from the first bytes; plain files pass through.
+typedef struct Json_stream {
+  Json_source source;     // Refilled from the queue by json_parse_stream
+  size_t capacity;        // Of source.data
+  int fd;
+  unsigned char magic[4]; // First bytes, read for detection and replayed to the decompressor
+  size_t magic_length;
+  JSON_COMPRESSION compression;
+  Queue chunks;           // Json_stream_chunk *, in file order
+  pthread_t thread;
+  int started;
+  int failed;             // Set by the decompression thread before it closes the queue
+} Json_stream;
+
+JSON_COMPRESSION json_detect_compression(const unsigned char *magic, size_t length);
+int json_stream_open(Json_stream *stream, const char *path);
+int json_stream_open_fd(Json_stream *stream, int fd);
+int json_stream_next(Json_stream *stream, Json_stream_chunk **chunk);
+int json_stream_lines(Json_stream *stream, Json_stream_line_callback callback, void *user_data);
+int json_stream_read_all(Json_stream *stream, char **data, size_t *length);
+int json_parse_stream(json_parser *parser, Json_stream *stream, Json_object *obj);
+int json_stream_close(Json_stream *stream);
+
+#endif // __STREAM__
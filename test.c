@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "json.h"
+
+// Regression tests, built with AddressSanitizer by `make test` so leaks
+// and invalid accesses fail the run.
+
+int failures = 0;
+
+void check(int condition, const char *name)
+{
+  if (!condition) {
+    fprintf(stderr, "FAIL %s\n", name);
+    failures++;
+  }
+}
+
+int load(const char *text, Json_object *obj)
+{
+  json_parser parser = {.flags = JSON_PARSE_EDITABLE};
+  memset(obj, 0, sizeof(*obj));
+  return json_parse_buffer(&parser, text, strlen(text), obj);
+}
+
+// A rejected edit frees the subtrees both reparses built and restores the source
+void test_failed_edit(void)
+{
+  const char *text = "{\"a\": [[1, 2], 3], \"b\": 4}";
+  Json_object obj;
+
+  check(load(text, &obj), "failed edit: parse");
+  check(!json_edit(&obj, 9, 1, "\"], [\"", 6), "failed edit: rejected");
+  check(obj.source_length == strlen(text) && memcmp(obj.source, text, obj.source_length) == 0,
+        "failed edit: source restored");
+  check(json_edit(&obj, 8, 1, "7", 1), "failed edit: document still editable");
+  json_unload(&obj);
+}
+
+// Edits that change the enclosing node's type fall back to a full reparse
+void test_fallback_edit(void)
+{
+  Json_object obj;
+
+  check(load("{\"a\": [[1, 2], 3], \"b\": 4}", &obj), "fallback edit: parse");
+  check(json_edit(&obj, 6, 11, "{\"c\": [true, null]}", 19), "fallback edit: applied");
+  json_unload(&obj);
+}
+
+// Random splices, most of which leave invalid JSON behind
+void test_random_edits(void)
+{
+  const char *pieces[] = {"[", "]", "{", "}", ",", ":", "\"k\"", "1", "-2.5e3", "true", "null", " ", "\"x\": [1]"};
+  const char *text = "{\"a\": [[1, 2], 3], \"b\": {\"c\": \"long enough string value\", \"d\": [true, false]}}";
+  Json_object obj;
+
+  check(load(text, &obj), "random edits: parse");
+  srand(1);
+  for (int i = 0; i < 5000; i++) {
+    size_t offset = (size_t)rand() % (obj.source_length + 1);
+    size_t removed = (size_t)rand() % 4;
+    if (offset + removed > obj.source_length) {
+      removed = obj.source_length - offset;
+    }
+    const char *piece = pieces[(size_t)rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+    json_edit(&obj, offset, removed, piece, strlen(piece));
+  }
+  json_unload(&obj);
+}
+
+// Packed integers read back exactly, like the same array parsed unpacked
+void test_packed_int64(void)
+{
+  const char *text = "{\"a\": [9007199254740993, -9223372036854775808, 9223372036854775807]}";
+  const char *expected[] = {"9007199254740993", "-9223372036854775808", "9223372036854775807"};
+  const int64_t values[] = {9007199254740993LL, INT64_MIN, INT64_MAX};
+  unsigned int flags[] = {JSON_PARSE_PACK_ARRAYS, JSON_PARSE_LAZY_NUMBERS};
+
+  for (size_t f = 0; f < 2; f++) {
+    json_parser parser = {.flags = flags[f]};
+    Json_object obj = {0};
+    check(json_parse_buffer(&parser, text, strlen(text), &obj), "packed int64: parse");
+
+    for (size_t i = 0; i < 3; i++) {
+      char path[16];
+      Json_node scratch;
+      Json_node *value = NULL;
+      int64_t integer = 0;
+      Vector out;
+
+      snprintf(path, sizeof(path), ".a[%zu]", i);
+      check(json_query_at(&obj.root, path, &scratch, &value) && value, "packed int64: query");
+      if (!value) {
+        continue;
+      }
+      check(json_number_int64(value, &integer) && integer == values[i], "packed int64: exact value");
+      vector_new(&out, 1, 32);
+      check(json_write(&out, value) && out.size == strlen(expected[i]) &&
+                memcmp(out.items, expected[i], out.size) == 0,
+            "packed int64: written exactly");
+      vector_deallocate(&out);
+    }
+    json_unload(&obj);
+  }
+}
+
+#define TEST_BATCH_FILES 64
+
+typedef struct Test_batch {
+  pthread_mutex_t lock;
+  const char **paths;
+  size_t calls;
+  size_t order[TEST_BATCH_FILES]; // Index of the path of each call
+  int seen[TEST_BATCH_FILES];
+  int ok[TEST_BATCH_FILES];
+  int value[TEST_BATCH_FILES];     // Value of "i" in the parsed document
+} Test_batch;
+
+void test_batch_callback(const char *path, Json_object *obj, int ok, void *user_data)
+{
+  Test_batch *batch = (Test_batch *)user_data;
+  size_t index = 0;
+  while (index < TEST_BATCH_FILES && batch->paths[index] != path) {
+    index++;
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  if (index < TEST_BATCH_FILES) {
+    batch->order[batch->calls] = index;
+    batch->seen[index]++;
+    batch->ok[index] = ok;
+    Json_node *value = NULL;
+    batch->value[index] = ok && json_query(&obj->root, ".i", &value) && value->type == JSON_NODE_NUMBER
+                              ? (int)json_number_value(value)
+                              : -1;
+  }
+  batch->calls++;
+  pthread_mutex_unlock(&batch->lock);
+}
+
+// Every third file is missing and every fifth one is invalid JSON
+void test_batch_run(const char **paths, size_t readers, size_t workers)
+{
+  Json_batch_options options = {.readers = readers, .workers = workers, .queue_size = 2};
+  Test_batch batch = {.paths = paths};
+  pthread_mutex_init(&batch.lock, NULL);
+
+  check(json_parse_files(paths, TEST_BATCH_FILES, &options, test_batch_callback, &batch), "batch: finished");
+  check(batch.calls == TEST_BATCH_FILES, "batch: one call per file");
+  for (size_t i = 0; i < TEST_BATCH_FILES; i++) {
+    int readable = i % 3 != 0 && i % 5 != 0;
+    check(batch.seen[i] == 1, "batch: every file seen once");
+    check(batch.ok[i] == readable, "batch: missing and invalid files fail");
+    check(!readable || batch.value[i] == (int)i, "batch: file parsed");
+    // A single reader and worker hand the files over in order
+    check(readers > 1 || workers > 1 || batch.order[i] == i, "batch: order kept");
+  }
+  pthread_mutex_destroy(&batch.lock);
+}
+
+void test_batch(void)
+{
+  char directory[] = "/tmp/json_test_XXXXXX";
+  char names[TEST_BATCH_FILES][64];
+  const char *paths[TEST_BATCH_FILES];
+
+  check(mkdtemp(directory) != NULL, "batch: temporary directory");
+  for (size_t i = 0; i < TEST_BATCH_FILES; i++) {
+    snprintf(names[i], sizeof(names[i]), "%s/%zu.json", directory, i);
+    paths[i] = names[i];
+    if (i % 3 == 0) {
+      continue;
+    }
+    FILE *file = fopen(names[i], "w");
+    if (file) {
+      fprintf(file, i % 5 == 0 ? "{\"i\": %zu," : "{\"i\": %zu, \"pad\": [1, 2, 3]}", i);
+      fclose(file);
+    }
+  }
+
+  test_batch_run(paths, 1, 1);
+  test_batch_run(paths, 4, 3);
+
+  // Nothing to do still returns once the threads are gone
+  Test_batch empty = {.paths = paths};
+  pthread_mutex_init(&empty.lock, NULL);
+  check(json_parse_files(paths, 0, NULL, test_batch_callback, &empty) && empty.calls == 0, "batch: no files");
+  pthread_mutex_destroy(&empty.lock);
+
+  for (size_t i = 0; i < TEST_BATCH_FILES; i++) {
+    unlink(names[i]);
+  }
+  rmdir(directory);
+}
+
+int main(void)
+{
+  test_failed_edit();
+  test_fallback_edit();
+  test_random_edits();
+  test_packed_int64();
+  test_batch();
+  if (failures) {
+    fprintf(stderr, "%d failed\n", failures);
+    return 1;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
@@ -90,6 +90,22 @@ int vector_push_back(Vector *vec, void *item)
   return 1;
 }
 
+int vector_append(Vector *vec, void *items, size_t count)
+{
+  if (vec->size + count > vec->capacity) {
+    size_t new_capacity = vec->capacity ? vec->capacity : 1;
+    while (new_capacity < vec->size + count) {
+      new_capacity *= 2;
+    }
+    if (!vector_reserve(vec, new_capacity)) {
+      return 0;
+    }
+  }
+  memcpy((char*)vec->items + (vec->size * vec->element_size), items, count * vec->element_size);
+  vec->size += count;
+  return 1;
+}
+
 int vector_copy(Vector* src, Vector* dst)
 {
   if (!vector_new(dst, src->element_size, src->capacity)) {
@@ -290,4 +306,111 @@ void hashmap_deallocate(HashMap *map)
             entry = next;
         }
     }
-}
\ No newline at end of file
+}
+
+
+
+int queue_new(Queue* queue, size_t capacity)
+{
+  queue->items = (void **)malloc(capacity * sizeof(void *));
+  if (!queue->items) {
+    fprintf(stderr, "ERROR! Couldn't allocate memory for queue\n");
+    return 0;
+  }
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->size = 0;
+  queue->closed = 0;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  return 1;
+}
+
+// Blocks while the queue is full, fails once the queue is closed
+int queue_push(Queue* queue, void* item)
+{
+  pthread_mutex_lock(&queue->lock);
+  while (queue->size == queue->capacity && !queue->closed) {
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+  }
+  if (queue->closed) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  queue->items[(queue->head + queue->size) % queue->capacity] = item;
+  queue->size++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+  return 1;
+}
+
+// Like queue_push but fails instead of blocking when the queue is full
+int queue_try_push(Queue* queue, void* item)
+{
+  pthread_mutex_lock(&queue->lock);
+  if (queue->size == queue->capacity || queue->closed) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  queue->items[(queue->head + queue->size) % queue->capacity] = item;
+  queue->size++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+  return 1;
+}
+
+// Blocks while the queue is empty, fails once it is closed and drained
+int queue_pop(Queue* queue, void** item)
+{
+  pthread_mutex_lock(&queue->lock);
+  while (queue->size == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+  if (queue->size == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  *item = queue->items[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->size--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return 1;
+}
+
+// Like queue_pop but fails instead of blocking when the queue is empty
+int queue_try_pop(Queue* queue, void** item)
+{
+  pthread_mutex_lock(&queue->lock);
+  if (queue->size == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  *item = queue->items[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->size--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return 1;
+}
+
+void queue_close(Queue* queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+void queue_deallocate(Queue* queue)
+{
+  free(queue->items);
+  queue->items = NULL;
+  queue->capacity = 0;
+  queue->size = 0;
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+}
@@ -2,6 +2,7 @@
 #define __UDS__
 
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 typedef struct Vector {
@@ -14,6 +15,7 @@ typedef struct Vector {
 int vector_new(Vector* vec, size_t element_size, ssize_t capacity);
 int vector_reserve(Vector* vec, size_t new_capacity);
 int vector_push_back(Vector* vec, void* item);
+int vector_append(Vector* vec, void* items, size_t count);
 void vector_deallocate(Vector* vec);
 int vector_copy(Vector* src, Vector* dst);
 size_t vector_get_size(Vector* vec);
@@ -76,5 +78,212 @@ unsigned int hash_string(void *key);
 
 
 
+// Type-specialized containers. The *_DECLARE macros only need T to be
+// declared, so a struct can hold a container of itself; the *_DEFINE macros
+// generate static inline operations once T is complete, letting the
+// compiler inline accesses with the element size known at compile time.
+
+#define VECTOR_DECLARE(Name, T)                                                    \
+  typedef struct Name {                                                            \
+    T *items;                                                                      \
+    size_t size;                                                                   \
+    size_t capacity;                                                               \
+  } Name;
+
+#define VECTOR_DEFINE(Name, T)                                                     \
+  static inline int Name##_reserve(Name *vec, size_t new_capacity)                \
+  {                                                                                \
+    if (new_capacity <= vec->capacity) {                                           \
+      return 1;                                                                    \
+    }                                                                              \
+    T *items = (T *)realloc(vec->items, new_capacity * sizeof(T));                 \
+    if (!items) {                                                                  \
+      fprintf(stderr, "ERROR! Couldn't reallocate memory for vector\n");           \
+      return 0;                                                                    \
+    }                                                                              \
+    vec->items = items;                                                            \
+    vec->capacity = new_capacity;                                                  \
+    return 1;                                                                      \
+  }                                                                                \
+                                                                                   \
+  static inline int Name##_new(Name *vec, size_t capacity)                        \
+  {                                                                                \
+    vec->items = NULL;                                                             \
+    vec->size = 0;                                                                 \
+    vec->capacity = 0;                                                             \
+    return Name##_reserve(vec, capacity);                                          \
+  }                                                                                \
+                                                                                   \
+  static inline void Name##_deallocate(Name *vec)                                 \
+  {                                                                                \
+    free(vec->items);                                                              \
+    vec->items = NULL;                                                             \
+    vec->size = 0;                                                                 \
+    vec->capacity = 0;                                                             \
+  }                                                                                \
+                                                                                   \
+  /* Makes room for count more items, doubling the capacity like push_back */   \
+  static inline int Name##_grow(Name *vec, size_t count)                          \
+  {                                                                                \
+    if (vec->size + count <= vec->capacity) {                                      \
+      return 1;                                                                    \
+    }                                                                              \
+    size_t new_capacity = vec->capacity ? vec->capacity : 1;                       \
+    while (new_capacity < vec->size + count) {                                     \
+      new_capacity *= 2;                                                           \
+    }                                                                              \
+    return Name##_reserve(vec, new_capacity);                                      \
+  }                                                                                \
+                                                                                   \
+  static inline int Name##_append(Name *vec, const T *items, size_t count)        \
+  {                                                                                \
+    if (count == 0) {                                                              \
+      return 1;                                                                    \
+    }                                                                              \
+    if (!Name##_grow(vec, count)) {                                                \
+      return 0;                                                                    \
+    }                                                                              \
+    memcpy(&vec->items[vec->size], items, count * sizeof(T));                     \
+    vec->size += count;                                                            \
+    return 1;                                                                      \
+  }                                                                                \
+                                                                                   \
+  static inline int Name##_push_back(Name *vec, const T *item)                    \
+  {                                                                                \
+    if (vec->size == vec->capacity &&                                              \
+        !Name##_reserve(vec, vec->capacity ? vec->capacity * 2 : 1)) {             \
+      return 0;                                                                    \
+    }                                                                              \
+    memcpy(&vec->items[vec->size++], item, sizeof(T));                            \
+    return 1;                                                                      \
+  }                                                                                \
+                                                                                   \
+  static inline T *Name##_get_ref_at(Name *vec, size_t index)                     \
+  {                                                                                \
+    return index < vec->size ? &vec->items[index] : NULL;                          \
+  }                                                                                \
+                                                                                   \
+  static inline size_t Name##_get_size(Name *vec)                                 \
+  {                                                                                \
+    return vec->size;                                                              \
+  }
+
+static inline unsigned int string_hash(const char *key)
+{
+  unsigned int hash = 5381;
+  for (; *key; key++) {
+    hash = ((hash << 5) + hash) + *key;
+  }
+  return hash % BUCKETS_SIZE;
+}
+
+static inline int string_compare(const char *key1, const char *key2)
+{
+  return strcmp(key1, key2);
+}
+
+// Values are stored inside the entries, keys are owned by the caller
+#define HASHMAP_DECLARE(Name, K, V)                                                \
+  typedef struct Name##Entry Name##Entry;                                          \
+  typedef struct Name {                                                            \
+    Name##Entry *buckets[BUCKETS_SIZE];                                            \
+  } Name;
+
+#define HASHMAP_DEFINE(Name, K, V, hash_function, key_cmp_function)                \
+  struct Name##Entry {                                                             \
+    Name##Entry *next;                                                             \
+    K key;                                                                         \
+    V value;                                                                       \
+  };                                                                               \
+                                                                                   \
+  static inline void Name##_new(Name *map)                                        \
+  {                                                                                \
+    memset(map->buckets, 0, sizeof(map->buckets));                                 \
+  }                                                                                \
+                                                                                   \
+  static inline V *Name##_search(Name *map, K key)                                \
+  {                                                                                \
+    for (Name##Entry *entry = map->buckets[hash_function(key)]; entry;             \
+         entry = entry->next) {                                                    \
+      if (key_cmp_function(entry->key, key) == 0) {                                \
+        return &entry->value;                                                      \
+      }                                                                            \
+    }                                                                              \
+    return NULL;                                                                   \
+  }                                                                                \
+                                                                                   \
+  /* Returns the value slot of key, adding an entry when *created is set */       \
+  static inline V *Name##_emplace(Name *map, K key, int *created)                 \
+  {                                                                                \
+    unsigned int index = hash_function(key);                                       \
+    for (Name##Entry *entry = map->buckets[index]; entry; entry = entry->next) {   \
+      if (key_cmp_function(entry->key, key) == 0) {                                \
+        *created = 0;                                                              \
+        return &entry->value;                                                      \
+      }                                                                            \
+    }                                                                              \
+    Name##Entry *entry = (Name##Entry *)malloc(sizeof(Name##Entry));               \
+    if (!entry) {                                                                  \
+      fprintf(stderr, "ERROR! Couldn't allocate memory for entry\n");              \
+      return NULL;                                                                 \
+    }                                                                              \
+    entry->key = key;                                                              \
+    entry->next = map->buckets[index];                                             \
+    map->buckets[index] = entry;                                                   \
+    *created = 1;                                                                  \
+    return &entry->value;                                                          \
+  }                                                                                \
+                                                                                   \
+  static inline int Name##_remove(Name *map, K key)                               \
+  {                                                                                \
+    Name##Entry **link = &map->buckets[hash_function(key)];                        \
+    for (; *link; link = &(*link)->next) {                                         \
+      if (key_cmp_function((*link)->key, key) == 0) {                              \
+        Name##Entry *entry = *link;                                                \
+        *link = entry->next;                                                       \
+        free(entry);                                                               \
+        return 1;                                                                  \
+      }                                                                            \
+    }                                                                              \
+    return 0;                                                                      \
+  }                                                                                \
+                                                                                   \
+  static inline void Name##_deallocate(Name *map)                                 \
+  {                                                                                \
+    for (size_t i = 0; i < BUCKETS_SIZE; i++) {                                    \
+      Name##Entry *entry = map->buckets[i];                                        \
+      while (entry) {                                                              \
+        Name##Entry *next = entry->next;                                           \
+        free(entry);                                                               \
+        entry = next;                                                              \
+      }                                                                            \
+      map->buckets[i] = NULL;                                                      \
+    }                                                                              \
+  }
+
+
+// Bounded blocking queue of pointers, safe to share between threads
+typedef struct Queue {
+  void **items;
+  size_t capacity;
+  size_t head;
+  size_t size;
+  int closed;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} Queue;
+
+int queue_new(Queue* queue, size_t capacity);
+int queue_push(Queue* queue, void* item);
+int queue_try_push(Queue* queue, void* item);
+int queue_pop(Queue* queue, void** item);
+int queue_try_pop(Queue* queue, void** item);
+void queue_close(Queue* queue);
+void queue_deallocate(Queue* queue);
+
+
+
+
 
 #endif // __UDS__
\ No newline at end of file
@@ -0,0 +1,518 @@
+#include "validate.h"
+
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Validation never allocates: the container stack is a fixed bitset on the
+// stack (1 = object, 0 = array) and line/column are only computed on error.
+
+typedef enum {
+  VALIDATE_VALUE,
+  VALIDATE_KEY,
+  VALIDATE_AFTER_VALUE
+} VALIDATE_STATE;
+
+int json_validate_fail(const char *buf, size_t offset, const char *message, Json_error *error)
+{
+  if (!error) {
+    return 0;
+  }
+
+  size_t line = 1;
+  size_t line_start = 0;
+  for (size_t i = 0; i < offset; i++) {
+    if (buf[i] == '\n') {
+      line++;
+      line_start = i + 1;
+    }
+  }
+
+  error->offset = offset;
+  error->line = line;
+  error->column = offset - line_start + 1;
+  error->message = message;
+  return 0;
+}
+
+// Returns the length of the UTF-8 sequence starting at buf[pos], 0 if invalid
+size_t json_utf8_sequence(const unsigned char *buf, size_t pos, size_t length)
+{
+  unsigned char c = buf[pos];
+  size_t n;
+  unsigned char lo = 0x80, hi = 0xBF;
+
+  if (c < 0x80) {
+    return 1;
+  } else if (c >= 0xC2 && c <= 0xDF) {
+    n = 2;
+  } else if (c >= 0xE0 && c <= 0xEF) {
+    n = 3;
+    if (c == 0xE0) {
+      lo = 0xA0;
+    } else if (c == 0xED) {
+      hi = 0x9F; // Surrogates are not valid scalar values
+    }
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    n = 4;
+    if (c == 0xF0) {
+      lo = 0x90;
+    } else if (c == 0xF4) {
+      hi = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+
+  if (length - pos < n) {
+    return 0;
+  }
+  if (buf[pos + 1] < lo || buf[pos + 1] > hi) {
+    return 0;
+  }
+  for (size_t i = 2; i < n; i++) {
+    if ((buf[pos + i] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+#ifdef __SSE2__
+// Bytes of x, taken as unsigned, that are >= k, for 0 < k <= 255
+static inline __m128i json_bytes_at_least(__m128i x, int k)
+{
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+  return _mm_cmpgt_epi8(_mm_xor_si128(x, bias), _mm_set1_epi8((char)((k - 1) ^ 0x80)));
+}
+
+// Marks the bytes of a 16-byte block that break UTF-8, given the block
+// before it. A sequence cut off at the end of the block isn't an error
+// here, its missing continuation bytes are checked with the next block.
+static inline __m128i json_utf8_block_errors(__m128i block, __m128i prev)
+{
+  __m128i prev1 = _mm_or_si128(_mm_slli_si128(block, 1), _mm_srli_si128(prev, 15));
+  __m128i prev2 = _mm_or_si128(_mm_slli_si128(block, 2), _mm_srli_si128(prev, 14));
+  __m128i prev3 = _mm_or_si128(_mm_slli_si128(block, 3), _mm_srli_si128(prev, 13));
+
+  // A continuation byte where, and only where, a lead byte asks for one
+  __m128i continuation = _mm_cmpeq_epi8(_mm_and_si128(block, _mm_set1_epi8((char)0xC0)), _mm_set1_epi8((char)0x80));
+  __m128i expected = _mm_or_si128(json_bytes_at_least(prev1, 0xC0),
+                                  _mm_or_si128(json_bytes_at_least(prev2, 0xE0), json_bytes_at_least(prev3, 0xF0)));
+  __m128i errors = _mm_xor_si128(continuation, expected);
+
+  // Lead bytes that are never valid, and overlong, surrogate or too large
+  // encodings, which show in the first continuation byte
+  __m128i lead = _mm_or_si128(_mm_cmpeq_epi8(_mm_or_si128(block, _mm_set1_epi8(1)), _mm_set1_epi8((char)0xC1)),
+                              json_bytes_at_least(block, 0xF5));
+  __m128i low = _mm_or_si128(
+      _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xE0)), _mm_xor_si128(json_bytes_at_least(block, 0xA0), continuation)),
+      _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xF0)), _mm_xor_si128(json_bytes_at_least(block, 0x90), continuation)));
+  __m128i high = _mm_or_si128(
+      _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xED)), json_bytes_at_least(block, 0xA0)),
+      _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xF4)), json_bytes_at_least(block, 0x90)));
+  return _mm_or_si128(_mm_or_si128(errors, lead), _mm_or_si128(low, high));
+}
+#endif
+
+// Returns how many bytes of string content starting at buf[pos], a
+// sequence boundary, are valid UTF-8, checked 16 bytes at a time. Stops
+// before a block holding a quote, a backslash, a control character or an
+// error, and always at a sequence boundary; the scalar path takes it from
+// there. 0 when there's nothing to check this way.
+size_t json_utf8_run(const unsigned char *buf, size_t pos, size_t length)
+{
+  size_t i = pos;
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  __m128i prev = _mm_setzero_si128();
+
+  while (i + 16 <= length) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+                                   _mm_xor_si128(json_bytes_at_least(block, 0x20), _mm_set1_epi8((char)0xFF)));
+    if (_mm_movemask_epi8(_mm_or_si128(special, json_utf8_block_errors(block, prev)))) {
+      break;
+    }
+    prev = block;
+    i += 16;
+  }
+
+  // Back up to the lead byte of the last sequence, which may be incomplete
+  if (i > pos) {
+    size_t continuations = 0;
+    while (continuations < 3 && (buf[i - 1] & 0xC0) == 0x80) {
+      i--;
+      continuations++;
+    }
+    if (i > pos && buf[i - 1] >= 0xC0) {
+      i--;
+    }
+  }
+#else
+  (void)buf;
+  (void)length;
+#endif
+  return i - pos;
+}
+
+// Moves *pos past the value starting there, 0 on malformed input. Only
+// the nesting is followed, the value itself isn't validated.
+int json_skip_value(const char *s, size_t length, size_t *pos)
+{
+  size_t i = *pos;
+  size_t depth = 0;
+
+  do {
+    if (i >= length) {
+      return 0;
+    }
+    char c = s[i];
+    if (c == '"') {
+      for (i++; i < length && s[i] != '"'; i++) {
+        if (s[i] == '\\') {
+          i++;
+        }
+      }
+      if (i >= length) {
+        return 0;
+      }
+      i++;
+    } else if (c == '{' || c == '[') {
+      depth++;
+      i++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        return 0;
+      }
+      depth--;
+      i++;
+    } else if (depth > 0) {
+      i++;
+    } else {
+      while (i < length && !json_is_space(s[i]) && s[i] != ',' && s[i] != '}' && s[i] != ']') {
+        i++;
+      }
+    }
+  } while (depth > 0);
+
+  *pos = i;
+  return 1;
+}
+
+int json_hex_value(unsigned char c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Reads the 4 hex digits of a \u escape starting at buf[pos], -1 if invalid
+long json_read_hex4(const unsigned char *buf, size_t pos, size_t length)
+{
+  if (length - pos < 4) {
+    return -1;
+  }
+  long value = 0;
+  for (size_t i = 0; i < 4; i++) {
+    int digit = json_hex_value(buf[pos + i]);
+    if (digit < 0) {
+      return -1;
+    }
+    value = (value << 4) | digit;
+  }
+  return value;
+}
+
+// Validates the string whose opening quote is at *pos and moves past the closing quote
+int json_validate_string(const unsigned char *s, size_t *pos, size_t length, const char **message)
+{
+  size_t i = *pos + 1;
+
+  for (;;) {
+#ifdef __SSE2__
+    // Skip 16 bytes at a time until a quote, a backslash, a control
+    // character or a non-ASCII byte (the signed compare catches both)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x20);
+    while (i + 16 <= length) {
+      __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+      __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                     _mm_cmplt_epi8(chunk, control));
+      int mask = _mm_movemask_epi8(special);
+      if (mask) {
+        i += __builtin_ctz(mask);
+        break;
+      }
+      i += 16;
+    }
+#endif
+    while (i < length && s[i] >= 0x20 && s[i] < 0x80 && s[i] != '"' && s[i] != '\\') {
+      i++;
+    }
+
+    if (i >= length) {
+      *pos = i;
+      *message = "Unterminated string";
+      return 0;
+    }
+
+    unsigned char c = s[i];
+    if (c == '"') {
+      *pos = i + 1;
+      return 1;
+    } else if (c == '\\') {
+      if (i + 1 >= length) {
+        *pos = i;
+        *message = "Unterminated escape sequence";
+        return 0;
+      }
+      switch (s[i + 1]) {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+          i += 2;
+          break;
+        case 'u':
+          {
+            long code = json_read_hex4(s, i + 2, length);
+            if (code < 0) {
+              *pos = i;
+              *message = "Invalid \\u escape";
+              return 0;
+            }
+            if (code >= 0xDC00 && code <= 0xDFFF) {
+              *pos = i;
+              *message = "Unpaired low surrogate in \\u escape";
+              return 0;
+            }
+            if (code >= 0xD800 && code <= 0xDBFF) {
+              long low = -1;
+              if (length - (i + 6) >= 2 && s[i + 6] == '\\' && s[i + 7] == 'u') {
+                low = json_read_hex4(s, i + 8, length);
+              }
+              if (low < 0xDC00 || low > 0xDFFF) {
+                *pos = i;
+                *message = "Unpaired high surrogate in \\u escape";
+                return 0;
+              }
+              i += 12;
+            } else {
+              i += 6;
+            }
+          }
+          break;
+        default:
+          *pos = i;
+          *message = "Invalid escape sequence";
+          return 0;
+      }
+    } else if (c < 0x20) {
+      *pos = i;
+      *message = "Unescaped control character in string";
+      return 0;
+    } else {
+      size_t n = json_utf8_run(s, i, length);
+      if (!n) {
+        n = json_utf8_sequence(s, i, length);
+      }
+      if (!n) {
+        *pos = i;
+        *message = "Invalid UTF-8";
+        return 0;
+      }
+      i += n;
+    }
+  }
+}
+
+int json_validate_number(const unsigned char *s, size_t *pos, size_t length, const char **message)
+{
+  size_t i = *pos;
+
+  if (s[i] == '-') {
+    i++;
+  }
+  if (i >= length || s[i] < '0' || s[i] > '9') {
+    *pos = i;
+    *message = "Expected a digit";
+    return 0;
+  }
+  if (s[i] == '0') {
+    i++;
+  } else {
+    while (i < length && s[i] >= '0' && s[i] <= '9') {
+      i++;
+    }
+  }
+
+  if (i < length && s[i] == '.') {
+    i++;
+    if (i >= length || s[i] < '0' || s[i] > '9') {
+      *pos = i;
+      *message = "Expected a digit after the decimal point";
+      return 0;
+    }
+    while (i < length && s[i] >= '0' && s[i] <= '9') {
+      i++;
+    }
+  }
+
+  if (i < length && (s[i] == 'e' || s[i] == 'E')) {
+    i++;
+    if (i < length && (s[i] == '+' || s[i] == '-')) {
+      i++;
+    }
+    if (i >= length || s[i] < '0' || s[i] > '9') {
+      *pos = i;
+      *message = "Expected a digit in the exponent";
+      return 0;
+    }
+    while (i < length && s[i] >= '0' && s[i] <= '9') {
+      i++;
+    }
+  }
+
+  *pos = i;
+  return 1;
+}
+
+int json_validate_literal(const unsigned char *s, size_t *pos, size_t length, const char *literal, size_t literal_length)
+{
+  if (length - *pos < literal_length) {
+    return 0;
+  }
+  for (size_t i = 0; i < literal_length; i++) {
+    if (s[*pos + i] != (unsigned char)literal[i]) {
+      return 0;
+    }
+  }
+  *pos += literal_length;
+  return 1;
+}
+
+int json_validate(const char *buf, size_t length, Json_error *error)
+{
+  const unsigned char *s = (const unsigned char *)buf;
+  uint64_t stack[JSON_VALIDATE_MAX_DEPTH / 64] = {0};
+  size_t depth = 0;
+  size_t pos = 0;
+  const char *message = NULL;
+  VALIDATE_STATE state = VALIDATE_VALUE;
+
+#define IN_OBJECT() ((stack[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1)
+#define SKIP_SPACE() while (pos < length && json_is_space(s[pos])) pos++
+
+  SKIP_SPACE();
+  for (;;) {
+    switch (state) {
+      case VALIDATE_VALUE:
+        {
+          if (pos >= length) {
+            return json_validate_fail(buf, pos, "Expected a value", error);
+          }
+          unsigned char c = s[pos];
+          if (c == '{' || c == '[') {
+            if (depth == JSON_VALIDATE_MAX_DEPTH) {
+              return json_validate_fail(buf, pos, "Maximum nesting depth exceeded", error);
+            }
+            if (c == '{') {
+              stack[depth / 64] |= (uint64_t)1 << (depth % 64);
+            } else {
+              stack[depth / 64] &= ~((uint64_t)1 << (depth % 64));
+            }
+            depth++;
+            pos++;
+            SKIP_SPACE();
+            if (pos < length && s[pos] == (c == '{' ? '}' : ']')) {
+              depth--;
+              pos++;
+              state = VALIDATE_AFTER_VALUE;
+            } else {
+              state = c == '{' ? VALIDATE_KEY : VALIDATE_VALUE;
+            }
+            continue;
+          } else if (c == '"') {
+            if (!json_validate_string(s, &pos, length, &message)) {
+              return json_validate_fail(buf, pos, message, error);
+            }
+          } else if (c == '-' || (c >= '0' && c <= '9')) {
+            if (!json_validate_number(s, &pos, length, &message)) {
+              return json_validate_fail(buf, pos, message, error);
+            }
+          } else if (c == 't') {
+            if (!json_validate_literal(s, &pos, length, "true", 4)) {
+              return json_validate_fail(buf, pos, "Invalid literal", error);
+            }
+          } else if (c == 'f') {
+            if (!json_validate_literal(s, &pos, length, "false", 5)) {
+              return json_validate_fail(buf, pos, "Invalid literal", error);
+            }
+          } else if (c == 'n') {
+            if (!json_validate_literal(s, &pos, length, "null", 4)) {
+              return json_validate_fail(buf, pos, "Invalid literal", error);
+            }
+          } else {
+            return json_validate_fail(buf, pos, "Expected a value", error);
+          }
+          state = VALIDATE_AFTER_VALUE;
+        }
+        break;
+      case VALIDATE_KEY:
+        {
+          if (pos >= length || s[pos] != '"') {
+            return json_validate_fail(buf, pos, "Expected a string key", error);
+          }
+          if (!json_validate_string(s, &pos, length, &message)) {
+            return json_validate_fail(buf, pos, message, error);
+          }
+          SKIP_SPACE();
+          if (pos >= length || s[pos] != ':') {
+            return json_validate_fail(buf, pos, "Expected ':'", error);
+          }
+          pos++;
+          SKIP_SPACE();
+          state = VALIDATE_VALUE;
+        }
+        break;
+      case VALIDATE_AFTER_VALUE:
+        {
+          SKIP_SPACE();
+          if (depth == 0) {
+            if (pos != length) {
+              return json_validate_fail(buf, pos, "Unexpected content after the document", error);
+            }
+            return 1;
+          }
+          if (pos >= length) {
+            return json_validate_fail(buf, pos, "Unexpected end of input", error);
+          }
+          unsigned char c = s[pos];
+          if (c == ',') {
+            pos++;
+            SKIP_SPACE();
+            state = IN_OBJECT() ? VALIDATE_KEY : VALIDATE_VALUE;
+          } else if (c == '}' && IN_OBJECT()) {
+            depth--;
+            pos++;
+          } else if (c == ']' && !IN_OBJECT()) {
+            depth--;
+            pos++;
+          } else {
+            return json_validate_fail(buf, pos, IN_OBJECT() ? "Expected ',' or '}'" : "Expected ',' or ']'", error);
+          }
+        }
+        break;
+    }
+  }
+
+#undef IN_OBJECT
+#undef SKIP_SPACE
+}
@@ -0,0 +1,24 @@
+#ifndef __VALIDATE__
+#define __VALIDATE__
+
+#include <stddef.h>
+
+#define JSON_VALIDATE_MAX_DEPTH 1024
+
+typedef struct Json_error {
+  size_t offset;       // Byte offset of the first invalid byte
+  size_t line;         // 1-based
+  size_t column;       // 1-based, in bytes
+  const char *message;
+} Json_error;
+
+int json_validate(const char *buf, size_t length, Json_error *error);
+int json_skip_value(const char *s, size_t length, size_t *pos);
+
+// The four whitespace bytes of the JSON grammar, unlike isspace
+static inline int json_is_space(unsigned char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+#endif // __VALIDATE__